@@ -0,0 +1,45 @@
+#version 330 core
+
+// expands one packed face record (see src/faces.h) into a quad
+in vec2 corner;
+in uint face;
+out vec2 fragment_texcoord;
+
+uniform mat4 MVP;
+uniform vec3 origin; // top-northeast corner of the chunk
+
+// face plane and axes in block space, indexed by direction
+const vec3 base[6] = vec3[6](
+    vec3(0, 0, 1), vec3(0, 0, 0), // north, south
+    vec3(0, 0, 0), vec3(1, 0, 0), // east, west
+    vec3(0, 1, 0), vec3(0, 0, 0)  // up, down
+);
+const vec3 u_axis[6] = vec3[6](
+    vec3(1, 0, 0), vec3(1, 0, 0),
+    vec3(0, 0, 1), vec3(0, 0, 1),
+    vec3(1, 0, 0), vec3(1, 0, 0)
+);
+const vec3 v_axis[6] = vec3[6](
+    vec3(0, 1, 0), vec3(0, 1, 0),
+    vec3(0, 1, 0), vec3(0, 1, 0),
+    vec3(0, 0, 1), vec3(0, 0, 1)
+);
+
+void main()
+{
+    vec3 block = vec3(float(face & 15u),
+                      float((face >> 4) & 15u),
+                      float((face >> 8) & 15u));
+    int dir = int((face >> 12) & 7u);
+    uint tile = (face >> 16) & 255u;
+
+    // a block spans x..x+1, y-1..y, z-1..z from its corner (see
+    // comp_block_vertex_data())
+    vec3 low = origin + block - vec3(0, 1, 1);
+    vec3 p = low + base[dir] + corner.x * u_axis[dir] + corner.y * v_axis[dir];
+    gl_Position = MVP * vec4(p, 1.0);
+
+    // atlas is 16x16 tiles, top of a tile has the smaller v
+    vec2 cell = vec2(float(tile % 16u), float(tile / 16u));
+    fragment_texcoord = (cell + vec2(corner.x, 1.0 - corner.y)) / 16.0;
+}
@@ -3,9 +3,15 @@
 // texture logic
 in vec2 fragment_texcoord;
 uniform sampler2D mytexture;
+uniform int overdraw; // 1 in the overdraw view, see set_overdraw_view()
 out vec3 color;
 
 void main()
 {
+    if (overdraw != 0)
+    {
+        color = vec3(0.1); // added up per pixel
+        return;
+    }
     color = texture2D(mytexture, fragment_texcoord).rgb; // TODO flip?
 }
@@ -0,0 +1,567 @@
+/*
+ * Implementation of asynchronous file I/O on io_uring, with a pread/pwrite
+ * thread pool as fallback.
+ *
+ * io_uring is driven through its raw system calls so there is no
+ * dependency on liburing.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define HAVE_IO_URING 1
+#else
+#define HAVE_IO_URING 0
+#endif
+
+#include "asyncio.h"
+
+#define OP_READ 0
+#define OP_WRITE 1
+
+typedef struct RequestTag
+{
+    int op; // OP_*
+    int fd;
+    void* buf;
+    size_t len;
+    long offset;
+    AsyncCallback callback;
+    void* arg;
+    long result;
+    struct iovec iov; // for io_uring's vectored ops
+    struct RequestTag* next;
+} Request;
+
+static int use_uring = 0;
+static Request* backlog_head = NULL; // queued, not handed to the backend
+static Request* backlog_tail = NULL;
+static int pending = 0; // requests whose callback has not run
+
+/*
+ * Run the callback of a finished request and free it.
+ */
+static void complete(Request* request)
+{
+    request->callback(request->arg, request->result);
+    free(request);
+    pending--;
+}
+
+static void enqueue(int op, int fd, void* buf, size_t len, long offset,
+                    AsyncCallback callback, void* arg)
+{
+    Request* request;
+
+    request = malloc(sizeof(Request));
+    request->op = op;
+    request->fd = fd;
+    request->buf = buf;
+    request->len = len;
+    request->offset = offset;
+    request->callback = callback;
+    request->arg = arg;
+    request->result = 0;
+    request->iov.iov_base = buf;
+    request->iov.iov_len = len;
+    request->next = NULL;
+
+    if (backlog_tail)
+    {
+        backlog_tail->next = request;
+    }
+    else
+    {
+        backlog_head = request;
+    }
+    backlog_tail = request;
+    pending++;
+}
+
+static Request* backlog_pop()
+{
+    Request* request = backlog_head;
+
+    if (request)
+    {
+        backlog_head = request->next;
+        if (backlog_head == NULL)
+        {
+            backlog_tail = NULL;
+        }
+        request->next = NULL;
+    }
+    return request;
+}
+
+// io_uring backend ===========================================================
+#if HAVE_IO_URING
+
+static struct
+{
+    int fd;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned sq_entries;
+    struct io_uring_sqe* sqes;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    int in_flight;
+} ring;
+
+static int uring_enter(unsigned to_submit, unsigned min_complete,
+                       unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, ring.fd, to_submit, min_complete,
+                        flags, NULL, 0);
+}
+
+static int uring_init()
+{
+    struct io_uring_params params;
+    char* sq;
+    char* cq;
+
+    memset(&params, 0, sizeof(params));
+    ring.fd = (int)syscall(__NR_io_uring_setup, ASYNC_QUEUE_DEPTH, &params);
+    if (ring.fd < 0)
+    {
+        return -1;
+    }
+
+    ring.sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cq_ring_size = params.cq_off.cqes +
+                        params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring.cq_ring_size > ring.sq_ring_size)
+        {
+            ring.sq_ring_size = ring.cq_ring_size;
+        }
+        ring.cq_ring_size = ring.sq_ring_size;
+    }
+
+    ring.sq_ring = mmap(NULL, ring.sq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if (ring.sq_ring == MAP_FAILED)
+    {
+        close(ring.fd);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring.cq_ring = ring.sq_ring;
+    }
+    else
+    {
+        ring.cq_ring = mmap(NULL, ring.cq_ring_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring.fd,
+                            IORING_OFF_CQ_RING);
+        if (ring.cq_ring == MAP_FAILED)
+        {
+            munmap(ring.sq_ring, ring.sq_ring_size);
+            close(ring.fd);
+            return -1;
+        }
+    }
+    ring.sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring.sqes = mmap(NULL, ring.sqes_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (ring.sqes == MAP_FAILED)
+    {
+        if (ring.cq_ring != ring.sq_ring)
+        {
+            munmap(ring.cq_ring, ring.cq_ring_size);
+        }
+        munmap(ring.sq_ring, ring.sq_ring_size);
+        close(ring.fd);
+        return -1;
+    }
+
+    sq = ring.sq_ring;
+    cq = ring.cq_ring;
+    ring.sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring.sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring.sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring.sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring.sq_entries = params.sq_entries;
+    ring.cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring.cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring.cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    ring.in_flight = 0;
+    return 0;
+}
+
+static void uring_shutdown()
+{
+    munmap(ring.sqes, ring.sqes_size);
+    if (ring.cq_ring != ring.sq_ring)
+    {
+        munmap(ring.cq_ring, ring.cq_ring_size);
+    }
+    munmap(ring.sq_ring, ring.sq_ring_size);
+    close(ring.fd);
+}
+
+static void uring_submit()
+{
+    struct io_uring_sqe* sqe;
+    Request* request;
+    unsigned tail;
+    unsigned unsubmitted;
+    int submitted;
+
+    tail = *ring.sq_tail;
+    // the completion ring holds twice the submission ring, so keeping at
+    // most sq_entries in flight means it never overflows
+    while (backlog_head &&
+           ring.in_flight + (int)(tail - __atomic_load_n(ring.sq_head,
+                                  __ATOMIC_ACQUIRE)) < (int)ring.sq_entries)
+    {
+        request = backlog_pop();
+        sqe = &ring.sqes[tail & *ring.sq_mask];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = (request->op == OP_READ) ? IORING_OP_READV
+                                               : IORING_OP_WRITEV;
+        sqe->fd = request->fd;
+        sqe->addr = (unsigned long)&request->iov;
+        sqe->len = 1;
+        sqe->off = (unsigned long)request->offset;
+        sqe->user_data = (unsigned long)request;
+        ring.sq_array[tail & *ring.sq_mask] = tail & *ring.sq_mask;
+        tail++;
+    }
+    __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+    // also covers entries a previous, partial io_uring_enter left behind
+    unsubmitted = tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+    if (unsubmitted == 0)
+    {
+        return;
+    }
+    do
+    {
+        submitted = uring_enter(unsubmitted, 0, 0);
+    } while (submitted < 0 && errno == EINTR);
+    if (submitted > 0)
+    {
+        ring.in_flight += submitted;
+    }
+}
+
+static int uring_reap()
+{
+    struct io_uring_cqe* cqe;
+    Request* request;
+    unsigned head;
+    int count = 0;
+
+    head = *ring.cq_head;
+    while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE))
+    {
+        cqe = &ring.cqes[head & *ring.cq_mask];
+        request = (Request*)(unsigned long)cqe->user_data;
+        request->result = cqe->res;
+        head++;
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+        ring.in_flight--;
+        complete(request);
+        count++;
+    }
+    return count;
+}
+
+static void uring_wait()
+{
+    int result;
+
+    do
+    {
+        result = uring_enter(0, 1, IORING_ENTER_GETEVENTS);
+    } while (result < 0 && errno == EINTR);
+}
+
+#endif
+// ============================================================================
+
+// thread pool backend ========================================================
+static pthread_t threads[ASYNC_THREADS];
+static pthread_mutex_t work_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static Request* work_head = NULL;
+static Request* work_tail = NULL;
+static int stopping = 0;
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static Request* done_head = NULL;
+
+/*
+ * Do a request with blocking calls, retrying short transfers.
+ */
+static void perform(Request* request)
+{
+    size_t done = 0;
+    ssize_t count;
+
+    while (done < request->len)
+    {
+        if (request->op == OP_READ)
+        {
+            count = pread(request->fd, (char*)request->buf + done,
+                          request->len - done, request->offset + done);
+        }
+        else
+        {
+            count = pwrite(request->fd, (char*)request->buf + done,
+                           request->len - done, request->offset + done);
+        }
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count < 0)
+        {
+            request->result = -errno;
+            return;
+        }
+        if (count == 0)
+        {
+            break; // end of file
+        }
+        done += count;
+    }
+    request->result = (long)done;
+}
+
+static void* io_thread_main(void* arg)
+{
+    Request* request;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&work_lock);
+        while (work_head == NULL && !stopping)
+        {
+            pthread_cond_wait(&work_cond, &work_lock);
+        }
+        request = work_head;
+        if (request == NULL)
+        {
+            pthread_mutex_unlock(&work_lock);
+            break; // stopping
+        }
+        work_head = request->next;
+        if (work_head == NULL)
+        {
+            work_tail = NULL;
+        }
+        pthread_mutex_unlock(&work_lock);
+
+        perform(request);
+
+        pthread_mutex_lock(&done_lock);
+        request->next = done_head;
+        done_head = request;
+        pthread_cond_signal(&done_cond);
+        pthread_mutex_unlock(&done_lock);
+    }
+    return NULL;
+}
+
+static void threads_submit()
+{
+    Request* request;
+
+    pthread_mutex_lock(&work_lock);
+    while ((request = backlog_pop()) != NULL)
+    {
+        if (work_tail)
+        {
+            work_tail->next = request;
+        }
+        else
+        {
+            work_head = request;
+        }
+        work_tail = request;
+    }
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&work_lock);
+}
+
+static int threads_reap()
+{
+    Request* request;
+    Request* next;
+    int count = 0;
+
+    pthread_mutex_lock(&done_lock);
+    request = done_head;
+    done_head = NULL;
+    pthread_mutex_unlock(&done_lock);
+
+    while (request)
+    {
+        next = request->next;
+        complete(request);
+        request = next;
+        count++;
+    }
+    return count;
+}
+
+static void threads_wait()
+{
+    pthread_mutex_lock(&done_lock);
+    while (done_head == NULL)
+    {
+        pthread_cond_wait(&done_cond, &done_lock);
+    }
+    pthread_mutex_unlock(&done_lock);
+}
+// ============================================================================
+
+int async_init(int force_threads)
+{
+    int idx;
+
+#if HAVE_IO_URING
+    if (!force_threads && uring_init() == 0)
+    {
+        use_uring = 1;
+        return 0;
+    }
+#endif
+
+    use_uring = 0;
+    stopping = 0;
+    for (idx = 0; idx < ASYNC_THREADS; idx++)
+    {
+        if (pthread_create(&threads[idx], NULL, io_thread_main, NULL) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void async_shutdown()
+{
+    int idx;
+
+    async_drain();
+#if HAVE_IO_URING
+    if (use_uring)
+    {
+        uring_shutdown();
+        return;
+    }
+#endif
+
+    pthread_mutex_lock(&work_lock);
+    stopping = 1;
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&work_lock);
+    for (idx = 0; idx < ASYNC_THREADS; idx++)
+    {
+        pthread_join(threads[idx], NULL);
+    }
+}
+
+const char* async_backend()
+{
+    return use_uring ? "io_uring" : "threads";
+}
+
+void async_read(int fd, void* buf, size_t len, long offset,
+                AsyncCallback callback, void* arg)
+{
+    enqueue(OP_READ, fd, buf, len, offset, callback, arg);
+}
+
+void async_write(int fd, const void* buf, size_t len, long offset,
+                 AsyncCallback callback, void* arg)
+{
+    enqueue(OP_WRITE, fd, (void*)buf, len, offset, callback, arg);
+}
+
+void async_submit()
+{
+#if HAVE_IO_URING
+    if (use_uring)
+    {
+        uring_submit();
+        return;
+    }
+#endif
+    threads_submit();
+}
+
+int async_poll()
+{
+    int count;
+
+#if HAVE_IO_URING
+    if (use_uring)
+    {
+        count = uring_reap();
+        uring_submit(); // room may have opened up for the backlog
+        return count;
+    }
+#endif
+    count = threads_reap();
+    return count;
+}
+
+void async_drain()
+{
+    async_submit();
+    while (pending > 0)
+    {
+        if (async_poll() > 0)
+        {
+            async_submit(); // callbacks may have queued more requests
+            continue;
+        }
+#if HAVE_IO_URING
+        if (use_uring)
+        {
+            if (ring.in_flight == 0)
+            {
+                uring_submit(); // all of it is still in the backlog
+            }
+            else
+            {
+                uring_wait();
+            }
+            continue;
+        }
+#endif
+        threads_wait();
+    }
+}
+
+int async_pending()
+{
+    return pending;
+}
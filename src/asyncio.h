@@ -0,0 +1,85 @@
+/*
+ * Asynchronous file I/O.
+ *
+ * Reads and writes are queued with async_read()/async_write(), handed to
+ * the kernel in batches by async_submit() and completed by async_poll(),
+ * which runs the callbacks of finished requests on the calling thread.
+ *
+ * On Linux the requests go through io_uring. If io_uring is not available
+ * (old kernel, seccomp, ...) a small pool of threads doing pread/pwrite is
+ * used instead, behind the same interface.
+ *
+ * All functions must be called from the same thread (the main thread).
+ */
+
+#ifndef ASYNCIO_H
+#define ASYNCIO_H
+
+#include <stddef.h>
+
+#define ASYNC_QUEUE_DEPTH 256 // requests in flight at once
+#define ASYNC_THREADS 4 // threads of the fallback backend
+
+/*
+ * Called when a request finished.
+ *
+ * @arg: argument given with the request.
+ * @result: bytes transferred (less than asked for at end of file), or
+ *   -errno on failure.
+ */
+typedef void (*AsyncCallback)(void* arg, long result);
+
+/*
+ * Set up the I/O backend. Returns 0 on success.
+ *
+ * @force_threads: use the thread pool even if io_uring is available.
+ */
+int async_init(int force_threads);
+
+/*
+ * Finish all requests and tear the backend down.
+ */
+void async_shutdown();
+
+/*
+ * Get the name of the backend in use.
+ */
+const char* async_backend();
+
+/*
+ * Queue a read of @len bytes at @offset of @fd into @buf. @buf must stay
+ * valid until @callback runs.
+ */
+void async_read(int fd, void* buf, size_t len, long offset,
+                AsyncCallback callback, void* arg);
+
+/*
+ * Queue a write of @len bytes of @buf at @offset of @fd. @buf must stay
+ * valid until @callback runs.
+ */
+void async_write(int fd, const void* buf, size_t len, long offset,
+                 AsyncCallback callback, void* arg);
+
+/*
+ * Hand all queued requests to the backend.
+ */
+void async_submit();
+
+/*
+ * Run the callbacks of finished requests. Never blocks. Returns the number
+ * of callbacks run.
+ */
+int async_poll();
+
+/*
+ * Submit everything and block until every request has completed and its
+ * callback has run.
+ */
+void async_drain();
+
+/*
+ * Get the number of requests that have not completed yet.
+ */
+int async_pending();
+
+#endif
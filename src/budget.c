@@ -0,0 +1,270 @@
+/*
+ * Implementation of memory budgets.
+ */
+
+#include <stdlib.h>
+
+#include "budget.h"
+#include "faces.h"
+#include "jobs.h"
+#include "mesh.h"
+#include "pipeline.h"
+#include "residency.h"
+
+#define MESH_VERTEX_BYTES (5 * sizeof(GLfloat)) // position and texcoord
+
+static float last_sweep = 0.0f;
+static BudgetStats stats = {
+    {0, 0, 0},
+    {GPU_BUDGET_BYTES, MESH_BUDGET_BYTES, DATA_BUDGET_BYTES},
+    {0, 0, 0}
+};
+
+static const char* kind_names[BUDGET_COUNT] = {"gpu", "mesh", "data"};
+
+static long mesh_bytes(const Mesh* mesh, int kind)
+{
+    if (mesh == NULL)
+    {
+        return 0;
+    }
+    if (kind == BUDGET_GPU)
+    {
+        return (mesh->vertex_array_id != 0) ?
+               (long)mesh->vertex_count * MESH_VERTEX_BYTES : 0;
+    }
+    return sizeof(Mesh) + (long)mesh->capacity * MESH_VERTEX_BYTES;
+}
+
+long chunk_bytes(const Chunk* chunk, int kind)
+{
+    long bytes = 0;
+
+    switch (kind)
+    {
+        case BUDGET_GPU:
+            bytes = mesh_bytes(chunk->mesh, kind);
+            if (chunk->faces)
+            {
+                bytes += (long)chunk->faces->gpu_capacity * sizeof(GLuint);
+            }
+            break;
+        case BUDGET_MESH:
+            bytes = mesh_bytes(chunk->mesh, kind) +
+                    mesh_bytes(chunk->pending_mesh, kind);
+            if (chunk->faces)
+            {
+                bytes += sizeof(FaceBuffer) +
+                         FACES_PER_CHUNK * sizeof(unsigned short) +
+                         (long)chunk->faces->capacity * sizeof(GLuint);
+            }
+            break;
+        case BUDGET_DATA:
+            bytes = sizeof(Chunk) +
+                    ((chunk->ids != NULL) ? BLOCKS_PER_CHUNK
+                                          : chunk->packed_size);
+            break;
+    }
+    return bytes;
+}
+
+/*
+ * Drop a chunk's mesh altogether, so it is meshed again when drawn.
+ */
+static void forget_mesh(Chunk* chunk)
+{
+    destroy_mesh(chunk->mesh);
+    chunk->mesh = NULL;
+    if (chunk->jobs[STAGE_MESH])
+    {
+        job_release(chunk->jobs[STAGE_MESH]);
+        chunk->jobs[STAGE_MESH] = NULL;
+    }
+}
+
+/*
+ * Drop a chunk's face buffer, GL buffer and records both. It is built
+ * again when the chunk is drawn.
+ */
+static void forget_faces(Chunk* chunk)
+{
+    destroy_face_buffer(chunk->faces);
+    chunk->faces = NULL;
+}
+
+static int by_last_visible(const void* a, const void* b)
+{
+    float ta = (*(Chunk* const*)a)->last_visible;
+    float tb = (*(Chunk* const*)b)->last_visible;
+
+    return (ta > tb) - (ta < tb);
+}
+
+/*
+ * Free one chunk's memory of a kind. Returns 0 if there was nothing the
+ * chunk could give up. The chunk is gone if @kind is BUDGET_DATA and
+ * *@unloaded is set.
+ */
+static int evict(Chunk* chunk, int kind, int* unloaded)
+{
+    int idle = __atomic_load_n(&chunk->busy, __ATOMIC_ACQUIRE) == 0;
+
+    *unloaded = 0;
+    switch (kind)
+    {
+        case BUDGET_GPU:
+            if (chunk->faces && idle)
+            {
+                forget_faces(chunk);
+                return 1;
+            }
+            if (chunk->mesh == NULL || chunk->mesh->vertex_array_id == 0)
+            {
+                return 0;
+            }
+            if (chunk->mesh->vertices == NULL)
+            {
+                // no copy to upload again from
+                if (!idle)
+                {
+                    return 0;
+                }
+                forget_mesh(chunk);
+                return 1;
+            }
+            mesh_unload(chunk->mesh);
+            return 1;
+
+        case BUDGET_MESH:
+            if (chunk->faces && idle)
+            {
+                forget_faces(chunk);
+                return 1;
+            }
+            if (chunk->mesh == NULL || chunk->mesh->vertex_count == 0 || !idle)
+            {
+                return 0; // empty meshes cost next to nothing to keep
+            }
+            if (chunk->mesh->vertex_array_id != 0 &&
+                chunk->mesh->vertices != NULL)
+            {
+                mesh_drop_cpu(chunk->mesh); // still drawable
+                return 1;
+            }
+            // nothing left worth keeping, mesh the chunk again when drawn
+            forget_mesh(chunk);
+            return 1;
+
+        case BUDGET_DATA:
+            if (!idle ||
+                __atomic_load_n(&chunk->wanted, __ATOMIC_RELAXED) >= WANT_DATA)
+            {
+                return 0;
+            }
+            if (chunk->ids != NULL)
+            {
+                return chunk_compress(chunk);
+            }
+            *unloaded = pipeline_unload(chunk);
+            return *unloaded;
+    }
+    return 0;
+}
+
+void budget_set_limit(int kind, long bytes)
+{
+    stats.limit[kind] = bytes;
+}
+
+void budget_update(World* world, float now)
+{
+    Chunk** chunks;
+    Chunk* chunk;
+    long before[BUDGET_COUNT];
+    int count = 0;
+    int unloaded;
+    int idx = 0;
+    int kind;
+    int k;
+
+    if (now - last_sweep < BUDGET_INTERVAL)
+    {
+        return;
+    }
+    last_sweep = now;
+
+    chunks = malloc((world->count + 1) * sizeof(Chunk*));
+    for (kind = 0; kind < BUDGET_COUNT; kind++)
+    {
+        stats.bytes[kind] = 0;
+    }
+    while ((chunk = world_next(world, &idx)) != NULL)
+    {
+        for (kind = 0; kind < BUDGET_COUNT; kind++)
+        {
+            stats.bytes[kind] += chunk_bytes(chunk, kind);
+        }
+        chunks[count++] = chunk;
+    }
+    qsort(chunks, count, sizeof(Chunk*), by_last_visible);
+
+    // least recently drawn first; dropping one kind can free others too
+    for (kind = 0; kind < BUDGET_COUNT; kind++)
+    {
+        for (idx = 0; idx < count && stats.bytes[kind] > stats.limit[kind];
+             idx++)
+        {
+            chunk = chunks[idx];
+            if (chunk == NULL)
+            {
+                continue; // unloaded
+            }
+            if (now - chunk->last_visible < BUDGET_GRACE)
+            {
+                break; // the rest is younger still
+            }
+
+            for (k = 0; k < BUDGET_COUNT; k++)
+            {
+                before[k] = chunk_bytes(chunk, k);
+            }
+            if (!evict(chunk, kind, &unloaded))
+            {
+                continue;
+            }
+            stats.evictions[kind]++;
+            for (k = 0; k < BUDGET_COUNT; k++)
+            {
+                stats.bytes[k] -= before[k];
+                if (!unloaded)
+                {
+                    stats.bytes[k] += chunk_bytes(chunk, k);
+                }
+            }
+            if (unloaded)
+            {
+                chunks[idx] = NULL;
+            }
+        }
+    }
+    free(chunks);
+}
+
+const BudgetStats* budget_stats()
+{
+    return &stats;
+}
+
+void budget_print(FILE* file)
+{
+    int kind;
+
+    fprintf(file, "budget:");
+    for (kind = 0; kind < BUDGET_COUNT; kind++)
+    {
+        fprintf(file, " %s %ld/%ld KiB (%ld evicted)%s", kind_names[kind],
+                stats.bytes[kind] / 1024, stats.limit[kind] / 1024,
+                stats.evictions[kind],
+                (kind < BUDGET_COUNT - 1) ? "," : "\n");
+    }
+}
@@ -0,0 +1,85 @@
+/*
+ * Memory budgets of the loaded chunks.
+ *
+ * Memory is accounted in three kinds, each against its own limit:
+ *
+ *   BUDGET_GPU:  GL buffers of baked meshes and face buffers.
+ *   BUDGET_MESH: CPU copies of meshes and face records.
+ *   BUDGET_DATA: block data (hot ids or cold run-length codes) and the
+ *                chunk objects themselves.
+ *
+ * When a kind is over its limit, chunks are evicted in order of when they
+ * were last drawn, oldest first, until it fits again. GPU buffers go
+ * first (the CPU copy of the mesh stays, so uploading it again is cheap;
+ * a mesh that has no copy left is dropped), then the meshes themselves
+ * (the chunk is remeshed when it is drawn again), then block data: hot
+ * chunks are compressed and cold ones are unloaded, saving them if they
+ * were edited. Face buffers have no cheap half to give up, so GPU and
+ * mesh eviction both drop them whole; they are built again when drawn.
+ * Chunks drawn in the last BUDGET_GRACE seconds are never evicted, nor is
+ * block data the pipeline still needs.
+ *
+ * Everything here runs on the main thread.
+ */
+
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <stdio.h>
+
+#include "chunk.h"
+#include "world.h"
+
+// kinds of memory, in eviction order
+#define BUDGET_GPU 0
+#define BUDGET_MESH 1
+#define BUDGET_DATA 2
+#define BUDGET_COUNT 3
+
+// default limits, sized for a machine with 4 GB
+#define GPU_BUDGET_BYTES (512L << 20)
+#define MESH_BUDGET_BYTES (256L << 20)
+#define DATA_BUDGET_BYTES (256L << 20)
+
+#define BUDGET_INTERVAL 0.5f // seconds between sweeps
+#define BUDGET_GRACE 1.0f // chunks drawn this recently are never evicted
+
+typedef struct BudgetStatsTag
+{
+    long bytes[BUDGET_COUNT]; // in use after the last sweep
+    long limit[BUDGET_COUNT];
+    long evictions[BUDGET_COUNT]; // since start
+} BudgetStats;
+
+/*
+ * Set the limit of a kind of memory.
+ *
+ * @kind: BUDGET_*.
+ * @bytes: new limit.
+ */
+void budget_set_limit(int kind, long bytes);
+
+/*
+ * Get the bytes of a kind of memory (BUDGET_*) held by a chunk.
+ */
+long chunk_bytes(const Chunk* chunk, int kind);
+
+/*
+ * Every BUDGET_INTERVAL seconds, account the memory of @world and evict
+ * chunks until every kind fits its limit.
+ *
+ * @now: residency clock (see residency.h).
+ */
+void budget_update(World* world, float now);
+
+/*
+ * Get the counters of the last sweep.
+ */
+const BudgetStats* budget_stats();
+
+/*
+ * Print the counters of the last sweep on one line.
+ */
+void budget_print(FILE* file);
+
+#endif
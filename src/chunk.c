@@ -0,0 +1,351 @@
+/*
+ * Implementation of chunk storage and render path bookkeeping.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk.h"
+#include "column.h"
+#include "compress.h"
+#include "faces.h"
+#include "jobs.h"
+#include "mesh.h"
+#include "residency.h"
+
+// shift of the last row of a solidity word
+#define TOP_ROW ((SOLID_ROWS_PER_WORD - 1) * CHUNK_SIZE)
+
+const int DIR_OFFSETS[DIR_COUNT][3] = {
+    { 0,  0,  1}, // north
+    { 0,  0, -1}, // south
+    {-1,  0,  0}, // east
+    { 1,  0,  0}, // west
+    { 0,  1,  0}, // up
+    { 0, -1,  0}, // down
+};
+
+Chunk* construct_chunk(int x, int y, int z)
+{
+    Chunk* new_chunk;
+    int stage;
+
+    new_chunk = malloc(sizeof(Chunk));
+
+    // init all blocks to air (BLOCK_AIR is 0)
+    new_chunk->ids = calloc(CHUNK_SIZE, sizeof(*new_chunk->ids));
+    new_chunk->packed = NULL;
+    new_chunk->packed_size = 0;
+    new_chunk->last_access = residency_now();
+    memset(new_chunk->solid, 0, sizeof(new_chunk->solid));
+    new_chunk->solid_ready = 0;
+    new_chunk->solid_count = 0;
+    new_chunk->flags = CHUNK_ALL_AIR | CHUNK_UNIFORM;
+    new_chunk->uniform_id = BLOCK_AIR;
+
+    new_chunk->a[0] = x;
+    new_chunk->a[1] = y;
+    new_chunk->a[2] = z;
+    new_chunk->render_path = RENDER_PATH_BAKED;
+    new_chunk->dirty = 0;
+    new_chunk->edits = 0;
+    new_chunk->edit_rate = 0.0f;
+    new_chunk->faces = NULL;
+    new_chunk->mesh = NULL;
+    new_chunk->pending_mesh = NULL;
+    for (stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        new_chunk->jobs[stage] = NULL;
+    }
+    new_chunk->busy = 0;
+    new_chunk->wanted = WANT_NONE;
+    new_chunk->io_state = IO_NONE;
+    new_chunk->modified = 0;
+    new_chunk->prefetched_at = -1.0f;
+    new_chunk->last_visible = residency_now();
+    new_chunk->column = NULL;
+    new_chunk->subscribers = 0;
+
+    return new_chunk;
+}
+
+void destroy_chunk(Chunk* chunk)
+{
+    int stage;
+
+    for (stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        if (chunk->jobs[stage])
+        {
+            job_release(chunk->jobs[stage]);
+        }
+    }
+    if (chunk->faces)
+    {
+        destroy_face_buffer(chunk->faces);
+    }
+    if (chunk->mesh)
+    {
+        destroy_mesh(chunk->mesh);
+    }
+    if (chunk->pending_mesh)
+    {
+        destroy_mesh(chunk->pending_mesh);
+    }
+    if (chunk->column)
+    {
+        column_release(chunk->column);
+    }
+    free(chunk->ids);
+    free(chunk->packed);
+    free(chunk);
+}
+
+/*
+ * Derive the flags of a chunk from its solid count after an edit that set a
+ * block to @id.
+ */
+static void update_flags(Chunk* chunk, int id)
+{
+    if ((chunk->flags & CHUNK_UNIFORM) && id != chunk->uniform_id)
+    {
+        chunk->flags &= ~CHUNK_UNIFORM;
+    }
+    chunk->flags &= ~(CHUNK_ALL_AIR | CHUNK_ALL_SOLID);
+    if (chunk->solid_count == 0)
+    {
+        // air is the only block that isn't solid
+        chunk->flags |= CHUNK_ALL_AIR | CHUNK_UNIFORM;
+        chunk->uniform_id = BLOCK_AIR;
+    }
+    else if (chunk->solid_count == BLOCKS_PER_CHUNK)
+    {
+        chunk->flags |= CHUNK_ALL_SOLID;
+    }
+}
+
+void set_block(Chunk* chunk, int id, int dx, int dy, int dz)
+{
+    unsigned long long* word;
+    unsigned long long bit;
+    int old_id;
+
+    chunk_touch(chunk);
+    old_id = (chunk->ids)[dx][dy][dz];
+    if (old_id == id)
+    {
+        return;
+    }
+    (chunk->ids)[dx][dy][dz] = (unsigned char)id;
+    word = &chunk->solid[dx][dy / SOLID_ROWS_PER_WORD];
+    bit = 1ULL << SOLID_SHIFT(dy, dz);
+    *word = BLOCK_SOLID(id) ? (*word | bit) : (*word & ~bit);
+    chunk->solid_count += BLOCK_SOLID(id) - BLOCK_SOLID(old_id);
+    update_flags(chunk, id);
+    chunk->edits++;
+    chunk->modified = 1;
+
+    if (chunk->render_path == RENDER_PATH_FACES && chunk->faces)
+    {
+        face_buffer_update_block(chunk->faces, chunk, dx, dy, dz);
+    }
+    else
+    {
+        chunk->dirty = 1;
+    }
+}
+
+void chunk_update_solid(Chunk* chunk)
+{
+    unsigned long long word = 0;
+    int first = (chunk->ids)[0][0][0];
+    int uniform = 1;
+    int count = 0;
+    int x;
+    int y;
+    int z;
+
+    for (x = 0; x < CHUNK_SIZE; x++)
+    {
+        for (y = 0; y < CHUNK_SIZE; y++)
+        {
+            if (y % SOLID_ROWS_PER_WORD == 0)
+            {
+                word = 0;
+            }
+            for (z = 0; z < CHUNK_SIZE; z++)
+            {
+                if (BLOCK_SOLID((chunk->ids)[x][y][z]))
+                {
+                    word |= 1ULL << SOLID_SHIFT(y, z);
+                }
+                uniform &= (chunk->ids)[x][y][z] == first;
+            }
+            chunk->solid[x][y / SOLID_ROWS_PER_WORD] = word;
+            if (y % SOLID_ROWS_PER_WORD == SOLID_ROWS_PER_WORD - 1)
+            {
+                count += __builtin_popcountll(word);
+            }
+        }
+    }
+
+    chunk->solid_count = count;
+    chunk->flags = (count == 0) ? CHUNK_ALL_AIR :
+                   (count == BLOCKS_PER_CHUNK) ? CHUNK_ALL_SOLID : 0;
+    if (uniform)
+    {
+        chunk->flags |= CHUNK_UNIFORM;
+        chunk->uniform_id = first;
+    }
+    __atomic_store_n(&chunk->solid_ready, 1, __ATOMIC_RELEASE);
+}
+
+int chunk_solid(const Chunk* chunk, int dx, int dy, int dz)
+{
+    return (chunk->solid[dx][dy / SOLID_ROWS_PER_WORD] >>
+            SOLID_SHIFT(dy, dz)) & 1;
+}
+
+void chunk_exposed_faces(const Chunk* chunk, int x, int word,
+                         unsigned long long* exposed)
+{
+    unsigned long long blocks = chunk->solid[x][word];
+    unsigned long long next;
+
+    // a block's neighbour along z is the next bit, along y the next 16 bits
+    // (or the next word), along x the same bit of the next x's word
+    next = (blocks >> 1) & ~SOLID_Z_HIGH;
+    exposed[DIR_NORTH] = blocks & ~next;
+    next = (blocks << 1) & ~SOLID_Z_LOW;
+    exposed[DIR_SOUTH] = blocks & ~next;
+    next = (x > 0) ? chunk->solid[x - 1][word] : 0;
+    exposed[DIR_EAST] = blocks & ~next;
+    next = (x < CHUNK_SIZE - 1) ? chunk->solid[x + 1][word] : 0;
+    exposed[DIR_WEST] = blocks & ~next;
+    next = blocks >> CHUNK_SIZE;
+    if (word < SOLID_WORDS - 1)
+    {
+        next |= chunk->solid[x][word + 1] << TOP_ROW;
+    }
+    exposed[DIR_UP] = blocks & ~next;
+    next = blocks << CHUNK_SIZE;
+    if (word > 0)
+    {
+        next |= chunk->solid[x][word - 1] >> TOP_ROW;
+    }
+    exposed[DIR_DOWN] = blocks & ~next;
+}
+
+int chunk_plane_solid(const Chunk* chunk, int dir)
+{
+    const unsigned long long all = ~0ULL;
+    const unsigned long long row = 0xffffULL;
+    int x;
+    int word;
+
+    if (chunk->flags & (CHUNK_ALL_AIR | CHUNK_ALL_SOLID))
+    {
+        return (chunk->flags & CHUNK_ALL_SOLID) != 0;
+    }
+
+    for (x = 0; x < CHUNK_SIZE; x++)
+    {
+        for (word = 0; word < SOLID_WORDS; word++)
+        {
+            switch (dir)
+            {
+                case DIR_NORTH:
+                    if ((chunk->solid[x][word] & SOLID_Z_HIGH) != SOLID_Z_HIGH)
+                    {
+                        return 0;
+                    }
+                    break;
+                case DIR_SOUTH:
+                    if ((chunk->solid[x][word] & SOLID_Z_LOW) != SOLID_Z_LOW)
+                    {
+                        return 0;
+                    }
+                    break;
+                case DIR_EAST:
+                    if (x == 0 && chunk->solid[x][word] != all)
+                    {
+                        return 0;
+                    }
+                    break;
+                case DIR_WEST:
+                    if (x == CHUNK_SIZE - 1 && chunk->solid[x][word] != all)
+                    {
+                        return 0;
+                    }
+                    break;
+                case DIR_UP:
+                    if (word == SOLID_WORDS - 1 &&
+                        (chunk->solid[x][word] >> TOP_ROW) != row)
+                    {
+                        return 0;
+                    }
+                    break;
+                case DIR_DOWN:
+                    if (word == 0 && (chunk->solid[x][word] & row) != row)
+                    {
+                        return 0;
+                    }
+                    break;
+            }
+        }
+    }
+    return 1;
+}
+
+int get_block(const Chunk* chunk, int dx, int dy, int dz)
+{
+    if (dx < 0 || dx >= CHUNK_SIZE ||
+        dy < 0 || dy >= CHUNK_SIZE ||
+        dz < 0 || dz >= CHUNK_SIZE)
+    {
+        return BLOCK_AIR;
+    }
+    if (chunk->ids == NULL)
+    {
+        if (chunk->flags & CHUNK_UNIFORM)
+        {
+            return chunk->uniform_id;
+        }
+        return rle_lookup(chunk->packed, chunk->packed_size,
+                          (dx * CHUNK_SIZE + dy) * CHUNK_SIZE + dz);
+    }
+    return (chunk->ids)[dx][dy][dz];
+}
+
+void chunk_tick(Chunk* chunk, float dt)
+{
+    float keep;
+
+    if (dt <= 0.0f)
+    {
+        return;
+    }
+
+    // exponential moving average of edits/sec, old edits fade out with
+    // EDIT_RATE_DECAY
+    keep = expf(-EDIT_RATE_DECAY * dt);
+    chunk->edit_rate = chunk->edit_rate * keep +
+                       (1.0f - keep) * ((float)chunk->edits / dt);
+    chunk->edits = 0;
+}
+
+int chunk_pick_render_path(const Chunk* chunk)
+{
+    if (chunk->render_path == RENDER_PATH_BAKED &&
+        chunk->edit_rate > FACES_ENTER_RATE)
+    {
+        return RENDER_PATH_FACES;
+    }
+    if (chunk->render_path == RENDER_PATH_FACES &&
+        chunk->edit_rate < FACES_EXIT_RATE)
+    {
+        return RENDER_PATH_BAKED;
+    }
+    return chunk->render_path;
+}
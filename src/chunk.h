@@ -0,0 +1,191 @@
+/*
+ * Chunks: 16x16x16 groups of blocks, and the bookkeeping that decides how
+ * each chunk is drawn.
+ *
+ * A chunk stores the id of every block it contains (the world data) next to
+ * the render data built from those ids. Render data is either a baked mesh
+ * (see mesh.h) or a compact face buffer (see faces.h) for chunks that are
+ * edited too often to rebake.
+ */
+
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#define CHUNK_SIZE 16 // 1 chunk: 16x16x16 blocks
+#define HUNK_SIZE 16 // 1 hunk: 16x16x16 chunks
+#define BLOCKS_PER_CHUNK (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE)
+
+// block ids
+#define BLOCK_AIR 0
+#define BLOCK_DIRT 1
+
+// solidity bitmask: one 64-bit word holds the z columns of 4 rows (y) at
+// one x, bit (dy % 4) * CHUNK_SIZE + dz
+#define SOLID_ROWS_PER_WORD 4
+#define SOLID_WORDS (CHUNK_SIZE / SOLID_ROWS_PER_WORD)
+#define SOLID_SHIFT(dy, dz) (((dy) % SOLID_ROWS_PER_WORD) * CHUNK_SIZE + (dz))
+#define SOLID_Z_LOW 0x0001000100010001ULL // bits of dz = 0 in a word
+#define SOLID_Z_HIGH (SOLID_Z_LOW << (CHUNK_SIZE - 1)) // bits of dz = 15
+#define BLOCK_SOLID(id) ((id) != BLOCK_AIR)
+
+// summary flags of a chunk's blocks
+#define CHUNK_ALL_AIR 1
+#define CHUNK_ALL_SOLID 2
+#define CHUNK_UNIFORM 4 // every block is uniform_id
+
+// render paths
+#define RENDER_PATH_BAKED 0 // one mesh per chunk, rebuilt on edit
+#define RENDER_PATH_FACES 1 // instanced face records, patched on edit
+
+// edit rates (edits/sec) at which a chunk switches render path. The gap
+// between them keeps a chunk from flipping back and forth.
+#define FACES_ENTER_RATE 4.0f
+#define FACES_EXIT_RATE 0.5f
+// how quickly the edit rate forgets old edits (per second)
+#define EDIT_RATE_DECAY 0.5f
+
+// directions, see top of main.c
+#define DIR_NORTH 0 // z+
+#define DIR_SOUTH 1 // z-
+#define DIR_EAST 2 // x-
+#define DIR_WEST 3 // x+
+#define DIR_UP 4 // y+
+#define DIR_DOWN 5 // y-
+#define DIR_COUNT 6
+
+// pipeline stages, see pipeline.h
+#define STAGE_GENERATE 0
+#define STAGE_LIGHT 1
+#define STAGE_MESH 2
+#define STAGE_COUNT 3
+
+// how much a chunk is still wanted by the pipeline
+#define WANT_NONE 0 // may be unloaded
+#define WANT_KEEP 1 // kept resident for quick revisits, no jobs
+#define WANT_DATA 2 // blocks needed by a neighbour's mesh
+#define WANT_MESH 3 // inside the view radius
+
+// state of a chunk's saved copy, see storage.h
+#define IO_NONE 0 // not looked for yet
+#define IO_READING 1 // read in flight
+#define IO_LOADED 2 // ids were read from disk
+#define IO_ABSENT 3 // never saved, ids have to be generated
+
+struct ColumnTag;
+struct FaceBufferTag;
+struct MeshTag;
+struct JobTag;
+
+typedef struct ChunkTag
+{
+    // see notebook p. 30 drawings
+    // block ids, NULL while the chunk is compressed (see residency.h)
+    unsigned char (*ids)[CHUNK_SIZE][CHUNK_SIZE];
+    unsigned char* packed; // run-length coded ids while compressed
+    int packed_size;
+    float last_access; // residency clock at last touch of the ids
+    // a bit per block, set if the block is solid. Kept while compressed.
+    unsigned long long solid[CHUNK_SIZE][SOLID_WORDS];
+    int solid_ready; // set once the blocks are generated or loaded
+    int solid_count; // number of solid blocks
+    int flags; // CHUNK_*, valid along with the bitmask
+    int uniform_id; // id of every block if CHUNK_UNIFORM
+    int a[3]; // coord of main corner (top, northeast)
+    int render_path; // RENDER_PATH_*
+    int dirty; // ids changed since the baked mesh was last built
+    int edits; // edits since last chunk_tick()
+    float edit_rate; // smoothed edits per second
+    struct FaceBufferTag* faces; // face buffer, only on RENDER_PATH_FACES
+    struct MeshTag* mesh; // baked mesh in use, NULL if none
+    struct MeshTag* pending_mesh; // built by a job, not adopted yet
+    struct JobTag* jobs[STAGE_COUNT]; // latest job of each stage
+    int busy; // jobs in flight that use this chunk
+    int wanted; // WANT_*
+    int io_state; // IO_*
+    int modified; // edited since last saved
+    float prefetched_at; // residency clock when last prefetched
+    float last_visible; // residency clock when last drawn
+    struct ColumnTag* column; // shared 2D fields, NULL until generated
+    unsigned int subscribers; // server clients holding a copy, see server.h
+} Chunk;
+
+/*
+ * Offset to the neighbouring block in each direction, indexed by DIR_*.
+ */
+extern const int DIR_OFFSETS[DIR_COUNT][3];
+
+/*
+ * Construct a chunk object. All blocks start as air.
+ *
+ * @x, @y, @z: coordinate of top-northeast corner of chunk.
+ */
+Chunk* construct_chunk(int x, int y, int z);
+
+/*
+ * Free a chunk and its render data. No job may be using the chunk.
+ */
+void destroy_chunk(Chunk* chunk);
+
+/*
+ * Set the id of a block in a chunk without building any render data.
+ *
+ * On RENDER_PATH_FACES the affected face records are patched in place, on
+ * RENDER_PATH_BAKED the chunk is marked dirty and has to be remeshed.
+ *
+ * @dx, @dy, @dz: relative coordinates of the block.
+ */
+void set_block(Chunk* chunk, int id, int dx, int dy, int dz);
+
+/*
+ * Rebuild a chunk's solidity bitmask, solid count and flags from its ids
+ * after they were written directly (generation, loading). Publishes them
+ * through solid_ready.
+ *
+ * set_block() keeps all of them up to date by itself, except that a chunk
+ * edited into a single material other than air is only seen as uniform
+ * after the next rebuild.
+ */
+void chunk_update_solid(Chunk* chunk);
+
+/*
+ * Get which faces of 64 blocks are exposed, i.e. have a non-solid
+ * neighbour, with whole-word shifts and masks. Blocks outside the chunk
+ * count as air.
+ *
+ * @x, @word: the blocks of chunk->solid[@x][@word].
+ * @exposed: receives a mask per DIR_*, bits laid out like the word.
+ */
+void chunk_exposed_faces(const Chunk* chunk, int x, int word,
+                         unsigned long long* exposed);
+
+/*
+ * Check if every block of a chunk's outermost layer in direction @dir is
+ * solid.
+ */
+int chunk_plane_solid(const Chunk* chunk, int dir);
+
+/*
+ * Check if a block of a chunk is solid, using the bitmask only.
+ *
+ * @dx, @dy, @dz: relative coordinates of the block, in range.
+ */
+int chunk_solid(const Chunk* chunk, int dx, int dy, int dz);
+
+/*
+ * Get the id of a block in a chunk. Out-of-range coordinates are air.
+ * Works on compressed chunks without decompressing them.
+ */
+int get_block(const Chunk* chunk, int dx, int dy, int dz);
+
+/*
+ * Advance the chunk's edit-rate estimate by @dt seconds.
+ */
+void chunk_tick(Chunk* chunk, float dt);
+
+/*
+ * Pick the render path a chunk should be on given its current edit rate.
+ * Does not change the chunk, the caller performs the switch.
+ */
+int chunk_pick_render_path(const Chunk* chunk);
+
+#endif
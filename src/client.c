@@ -0,0 +1,251 @@
+/*
+ * Implementation of the chunk server client.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "client.h"
+#include "compress.h"
+#include "faces.h"
+#include "net.h"
+#include "residency.h"
+
+static World* world;
+static Connection* server = NULL;
+static int radius;
+static int center[3];
+static int have_center = 0;
+static int pending_drops = 0;
+
+/*
+ * Chebyshev distance from the camera's chunk to chunk @c.
+ */
+static int distance(const int* c)
+{
+    int d = 0;
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (abs(c[i] - center[i]) > d)
+        {
+            d = abs(c[i] - center[i]);
+        }
+    }
+    return d;
+}
+
+/*
+ * Refresh the render data of a chunk whose ids changed.
+ */
+static void chunk_changed(Chunk* chunk)
+{
+    chunk->modified = 0; // the server saves it
+    if (chunk->render_path == RENDER_PATH_FACES && chunk->faces)
+    {
+        face_buffer_build(chunk->faces, chunk);
+    }
+    else
+    {
+        chunk->dirty = 1;
+    }
+}
+
+/*
+ * Apply a message. Returns 0 if it has to wait for a job to finish.
+ */
+static int apply_message(int type, const unsigned char* payload, int size)
+{
+    const unsigned char* at;
+    Chunk* chunk;
+    int c[3];
+    int idx;
+
+    if ((type != MSG_CHUNK && type != MSG_DELTA) || size < CHUNK_HEADER_SIZE)
+    {
+        return 1; // not for us
+    }
+    for (idx = 0; idx < 3; idx++)
+    {
+        c[idx] = (int)get_u32(payload + 4 * idx);
+    }
+
+    chunk = world_get(world, c[0], c[1], c[2]);
+    if (chunk == NULL)
+    {
+        // changes to a dropped chunk, or a chunk that left the view while
+        // on its way (the server forgets it too)
+        if (type == MSG_DELTA || distance(c) > radius + NET_KEEP_CHUNKS)
+        {
+            return 1;
+        }
+        chunk = world_add(world, c[0], c[1], c[2]);
+    }
+    if (__atomic_load_n(&chunk->busy, __ATOMIC_ACQUIRE) != 0)
+    {
+        return 0; // a mesh job reads the ids
+    }
+    chunk_touch(chunk);
+
+    if (type == MSG_CHUNK)
+    {
+        if (rle_decode(payload + CHUNK_HEADER_SIZE, size - CHUNK_HEADER_SIZE,
+                       (unsigned char*)chunk->ids, BLOCKS_PER_CHUNK) !=
+            BLOCKS_PER_CHUNK)
+        {
+            fprintf(stderr, "Bad chunk from server.\n");
+            return 1;
+        }
+        chunk_update_solid(chunk);
+        chunk->io_state = IO_LOADED;
+        __atomic_store_n(&chunk->wanted, WANT_MESH, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        for (at = payload + CHUNK_HEADER_SIZE;
+             at + DELTA_ENTRY_SIZE <= payload + size; at += DELTA_ENTRY_SIZE)
+        {
+            idx = (int)get_u16(at) % BLOCKS_PER_CHUNK;
+            set_block(chunk, at[2], idx / (CHUNK_SIZE * CHUNK_SIZE),
+                      (idx / CHUNK_SIZE) % CHUNK_SIZE, idx % CHUNK_SIZE);
+        }
+    }
+    chunk_changed(chunk);
+    return 1;
+}
+
+/*
+ * Free the chunks that left the view, unless jobs still use them.
+ */
+static void drop_chunks()
+{
+    Chunk** doomed;
+    Chunk* chunk;
+    int c[3];
+    int count = 0;
+    int idx = 0;
+    int i;
+
+    doomed = malloc(world->count * sizeof(Chunk*));
+    pending_drops = 0;
+    while ((chunk = world_next(world, &idx)) != NULL)
+    {
+        for (i = 0; i < 3; i++)
+        {
+            c[i] = chunk_coord(chunk->a[i]);
+        }
+        if (distance(c) <= radius + NET_KEEP_CHUNKS)
+        {
+            continue;
+        }
+        if (__atomic_load_n(&chunk->busy, __ATOMIC_ACQUIRE) == 0)
+        {
+            doomed[count++] = chunk;
+        }
+        else
+        {
+            pending_drops = 1; // try again next frame
+        }
+    }
+    for (idx = 0; idx < count; idx++)
+    {
+        world_remove(world, doomed[idx]);
+        destroy_chunk(doomed[idx]);
+    }
+    free(doomed);
+}
+
+int client_init(World* new_world, const char* address, int new_radius)
+{
+    int fd = net_connect(address);
+
+    if (fd < 0)
+    {
+        return 1;
+    }
+    world = new_world;
+    server = construct_connection(fd);
+    radius = new_radius;
+    have_center = 0;
+    printf("Connected to %s\n", address);
+    return 0;
+}
+
+void client_set_radius(int new_radius)
+{
+    radius = new_radius;
+    have_center = 0; // report the camera again
+}
+
+void client_shutdown()
+{
+    if (server)
+    {
+        destroy_connection(server);
+        server = NULL;
+    }
+}
+
+int client_update(const float* p)
+{
+    const unsigned char* payload;
+    unsigned char camera[16];
+    int c[3];
+    int type;
+    int size;
+    int got;
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        c[i] = chunk_coord((int)floorf(p[i]));
+    }
+    if (!have_center || c[0] != center[0] || c[1] != center[1] ||
+        c[2] != center[2])
+    {
+        for (i = 0; i < 3; i++)
+        {
+            center[i] = c[i];
+            put_u32(camera + 4 * i,
+                    (unsigned int)(int)floorf(p[i] * CAMERA_SCALE));
+        }
+        put_u32(camera + 12, (unsigned int)radius);
+        net_send(server, MSG_CAMERA, camera, sizeof(camera));
+        have_center = 1;
+        pending_drops = 1;
+    }
+
+    if (net_receive(server) != 0)
+    {
+        return -1;
+    }
+    while ((got = net_peek(server, &type, &payload, &size)) == 1 &&
+           apply_message(type, payload, size))
+    {
+        net_pop(server);
+    }
+    if (got < 0)
+    {
+        fprintf(stderr, "Server sent garbage.\n");
+        return -1;
+    }
+
+    if (pending_drops)
+    {
+        drop_chunks();
+    }
+    return net_flush(server);
+}
+
+void client_edit(int x, int y, int z, int id)
+{
+    unsigned char edit[13];
+
+    put_u32(edit, (unsigned int)x);
+    put_u32(edit + 4, (unsigned int)y);
+    put_u32(edit + 8, (unsigned int)z);
+    edit[12] = (unsigned char)id;
+    net_send(server, MSG_EDIT, edit, sizeof(edit));
+}
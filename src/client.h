@@ -0,0 +1,51 @@
+/*
+ * Client of the chunk server (see server.h): fills the local world with the
+ * chunks the server streams instead of generating them.
+ *
+ * Received chunks and block changes go straight into the chunks' ids and
+ * mark them dirty, so the usual remeshing in the draw loop picks them up.
+ * Chunks are never saved on the client, the server owns the world. Chunks
+ * that fell out of view are dropped locally and sent again on return.
+ *
+ * Everything here runs on the main thread.
+ */
+
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include "world.h"
+
+/*
+ * Connect to the server at @address and stream chunks into @world. The
+ * pipeline must be set up on @world for remeshing (see pipeline.h), but
+ * not updated. Returns 0 on success.
+ *
+ * @radius: view radius in chunks.
+ */
+int client_init(World* world, const char* address, int radius);
+
+/*
+ * Change the view radius (in chunks) and tell the server.
+ */
+void client_set_radius(int radius);
+
+/*
+ * Disconnect from the server.
+ */
+void client_shutdown();
+
+/*
+ * Report the camera at @p (x, y, z) to the server and apply what it sent.
+ * Call once per frame. Returns -1 if the connection was lost.
+ */
+int client_update(const float* p);
+
+/*
+ * Ask the server to set a block. The change shows once the server sends
+ * it back.
+ *
+ * @x, @y, @z: block coordinates.
+ */
+void client_edit(int x, int y, int z, int id);
+
+#endif
@@ -0,0 +1,331 @@
+/*
+ * Implementation of box collision.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "collide.h"
+
+/*
+ * Block (x, y, z) fills x..x+1, y-1..y, z-1..z (see main.c), so a point at
+ * u on an axis lies in block floor(u + CELL_OFFSET[axis]).
+ */
+static const int CELL_OFFSET[3] = {0, 1, 1};
+
+/*
+ * Order in which the axes of a move are resolved. Vertical first so a
+ * falling box lands before it slides.
+ */
+static const int AXIS_ORDER[3] = {1, 0, 2};
+
+/*
+ * The last chunk looked up. Boxes are small, so most lookups hit it.
+ */
+typedef struct LookupTag
+{
+    const World* world;
+    int c[3];
+    const Chunk* chunk; // NULL if not loaded or not generated
+    int valid;
+} Lookup;
+
+static const Chunk* lookup_chunk(Lookup* lookup, int cx, int cy, int cz)
+{
+    const Chunk* chunk;
+
+    if (!lookup->valid || cx != lookup->c[0] || cy != lookup->c[1] ||
+        cz != lookup->c[2])
+    {
+        chunk = world_get(lookup->world, cx, cy, cz);
+        if (chunk && !__atomic_load_n(&chunk->solid_ready, __ATOMIC_ACQUIRE))
+        {
+            chunk = NULL;
+        }
+        lookup->c[0] = cx;
+        lookup->c[1] = cy;
+        lookup->c[2] = cz;
+        lookup->chunk = chunk;
+        lookup->valid = 1;
+    }
+    return lookup->chunk;
+}
+
+/*
+ * Check if any block in the (inclusive) range @lo..@hi of block
+ * coordinates is solid. Runs along z test up to a chunk's worth of blocks
+ * with one mask.
+ */
+static int range_solid(Lookup* lookup, const int* lo, const int* hi)
+{
+    const Chunk* chunk;
+    unsigned long long bits;
+    int cx;
+    int cy;
+    int cz;
+    int x;
+    int y;
+    int z;
+    int dz;
+    int end;
+
+    for (x = lo[0]; x <= hi[0]; x++)
+    {
+        cx = chunk_coord(x);
+        for (y = lo[1]; y <= hi[1]; y++)
+        {
+            cy = chunk_coord(y);
+            for (z = lo[2]; z <= hi[2]; z = end + 1)
+            {
+                cz = chunk_coord(z);
+                end = cz * CHUNK_SIZE + CHUNK_SIZE - 1;
+                if (end > hi[2])
+                {
+                    end = hi[2];
+                }
+                chunk = lookup_chunk(lookup, cx, cy, cz);
+                if (chunk == NULL || (chunk->flags & CHUNK_ALL_AIR))
+                {
+                    continue;
+                }
+                if (chunk->flags & CHUNK_ALL_SOLID)
+                {
+                    return 1;
+                }
+
+                // z column of this row, then the blocks z..end of it
+                dz = z - cz * CHUNK_SIZE;
+                bits = chunk->solid[x - cx * CHUNK_SIZE]
+                                   [(y - cy * CHUNK_SIZE) / SOLID_ROWS_PER_WORD];
+                bits >>= SOLID_SHIFT(y - cy * CHUNK_SIZE, dz);
+                bits &= (1ULL << (end - z + 1)) - 1;
+                if (bits)
+                {
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static int cell(float u, int axis)
+{
+    return (int)floorf(u + CELL_OFFSET[axis]);
+}
+
+/*
+ * Move a box along one axis, stopping at the first solid block layer.
+ * Returns 1 if the box was stopped.
+ */
+static int collide_axis(Lookup* lookup, float* p, const float* half,
+                        int axis, float d)
+{
+    int lo[3];
+    int hi[3];
+    int i;
+    int layer;
+    int first;
+    int last;
+    float edge;
+    float move;
+
+    if (d == 0.0f)
+    {
+        return 0;
+    }
+
+    // blocks the box overlaps on the other axes
+    for (i = 0; i < 3; i++)
+    {
+        lo[i] = cell(p[i] - half[i] + COLLIDE_SKIN, i);
+        hi[i] = cell(p[i] + half[i] - COLLIDE_SKIN, i);
+    }
+
+    // walk the block layers the leading face enters, nearest first
+    if (d > 0.0f)
+    {
+        edge = p[axis] + half[axis];
+        first = cell(edge - COLLIDE_SKIN, axis) + 1;
+        last = cell(edge + d - COLLIDE_SKIN, axis);
+        for (layer = first; layer <= last; layer++)
+        {
+            lo[axis] = layer;
+            hi[axis] = layer;
+            if (range_solid(lookup, lo, hi))
+            {
+                move = (float)(layer - CELL_OFFSET[axis]) - edge;
+                p[axis] += (move > 0.0f) ? move : 0.0f;
+                return 1;
+            }
+        }
+    }
+    else
+    {
+        edge = p[axis] - half[axis];
+        first = cell(edge + COLLIDE_SKIN, axis) - 1;
+        last = cell(edge + d + COLLIDE_SKIN, axis);
+        for (layer = first; layer >= last; layer--)
+        {
+            lo[axis] = layer;
+            hi[axis] = layer;
+            if (range_solid(lookup, lo, hi))
+            {
+                move = (float)(layer + 1 - CELL_OFFSET[axis]) - edge;
+                p[axis] += (move < 0.0f) ? move : 0.0f;
+                return 1;
+            }
+        }
+    }
+    p[axis] += d;
+    return 0;
+}
+
+static int collide_lookup(Lookup* lookup, float* p, const float* half,
+                          const float* d)
+{
+    int hits = 0;
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (collide_axis(lookup, p, half, AXIS_ORDER[i], d[AXIS_ORDER[i]]))
+        {
+            hits |= 1 << AXIS_ORDER[i]; // HIT_X, HIT_Y, HIT_Z
+        }
+    }
+    return hits;
+}
+
+Bodies* construct_bodies(int capacity)
+{
+    Bodies* bodies;
+    int axis;
+
+    if (capacity < 1)
+    {
+        capacity = 1;
+    }
+    bodies = malloc(sizeof(Bodies));
+    for (axis = 0; axis < 3; axis++)
+    {
+        bodies->p[axis] = malloc(capacity * sizeof(float));
+        bodies->v[axis] = malloc(capacity * sizeof(float));
+        bodies->half[axis] = malloc(capacity * sizeof(float));
+    }
+    bodies->hits = malloc(capacity);
+    bodies->count = 0;
+    bodies->capacity = capacity;
+    return bodies;
+}
+
+void destroy_bodies(Bodies* bodies)
+{
+    int axis;
+
+    for (axis = 0; axis < 3; axis++)
+    {
+        free(bodies->p[axis]);
+        free(bodies->v[axis]);
+        free(bodies->half[axis]);
+    }
+    free(bodies->hits);
+    free(bodies);
+}
+
+int bodies_add(Bodies* bodies, const float* p, const float* half,
+               const float* v)
+{
+    int axis;
+    int idx;
+
+    if (bodies->count == bodies->capacity)
+    {
+        bodies->capacity *= 2;
+        for (axis = 0; axis < 3; axis++)
+        {
+            bodies->p[axis] = realloc(bodies->p[axis],
+                                      bodies->capacity * sizeof(float));
+            bodies->v[axis] = realloc(bodies->v[axis],
+                                      bodies->capacity * sizeof(float));
+            bodies->half[axis] = realloc(bodies->half[axis],
+                                         bodies->capacity * sizeof(float));
+        }
+        bodies->hits = realloc(bodies->hits, bodies->capacity);
+    }
+
+    idx = bodies->count++;
+    for (axis = 0; axis < 3; axis++)
+    {
+        bodies->p[axis][idx] = p[axis];
+        bodies->v[axis][idx] = v[axis];
+        bodies->half[axis][idx] = half[axis];
+    }
+    bodies->hits[idx] = 0;
+    return idx;
+}
+
+void bodies_remove(Bodies* bodies, int idx)
+{
+    int last = --bodies->count;
+    int axis;
+
+    for (axis = 0; axis < 3; axis++)
+    {
+        bodies->p[axis][idx] = bodies->p[axis][last];
+        bodies->v[axis][idx] = bodies->v[axis][last];
+        bodies->half[axis][idx] = bodies->half[axis][last];
+    }
+    bodies->hits[idx] = bodies->hits[last];
+}
+
+void bodies_step(const World* world, Bodies* bodies, float dt)
+{
+    Lookup lookup = {world, {0, 0, 0}, NULL, 0};
+    float p[3];
+    float half[3];
+    float d[3];
+    int hits;
+    int idx;
+    int axis;
+
+    for (idx = 0; idx < bodies->count; idx++)
+    {
+        for (axis = 0; axis < 3; axis++)
+        {
+            p[axis] = bodies->p[axis][idx];
+            half[axis] = bodies->half[axis][idx];
+            d[axis] = bodies->v[axis][idx] * dt;
+        }
+
+        hits = collide_lookup(&lookup, p, half, d);
+
+        for (axis = 0; axis < 3; axis++)
+        {
+            bodies->p[axis][idx] = p[axis];
+            if (hits & (1 << axis))
+            {
+                bodies->v[axis][idx] = 0.0f;
+            }
+        }
+        bodies->hits[idx] = (unsigned char)hits;
+    }
+}
+
+int collide_box(const World* world, float* p, const float* half,
+                const float* d)
+{
+    Lookup lookup = {world, {0, 0, 0}, NULL, 0};
+    return collide_lookup(&lookup, p, half, d);
+}
+
+int world_solid(const World* world, int x, int y, int z)
+{
+    Lookup lookup = {world, {0, 0, 0}, NULL, 0};
+    int b[3];
+
+    b[0] = x;
+    b[1] = y;
+    b[2] = z;
+    return range_solid(&lookup, b, b);
+}
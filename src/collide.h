@@ -0,0 +1,94 @@
+/*
+ * Collision of axis-aligned boxes with the solid blocks of the world.
+ *
+ * A box is moved one axis at a time (y, then x, then z) and stops flush
+ * against the first solid block it would enter on that axis, so boxes
+ * slide along walls and floors. Every block layer the box sweeps through
+ * is checked, however far it moves, so nothing tunnels through thin walls.
+ *
+ * Only the chunks' solidity bitmasks are read (see chunk.h), never their
+ * ids, so compressed chunks are not touched. Chunks that are not loaded or
+ * not generated yet are treated as air.
+ *
+ * Many bodies are moved at once with bodies_step(). Bodies are stored as
+ * structure of arrays so the step walks each component linearly.
+ *
+ * Everything here runs on the main thread.
+ */
+
+#ifndef COLLIDE_H
+#define COLLIDE_H
+
+#include "world.h"
+
+// axes a box was stopped on, see collide_box()
+#define HIT_X 1
+#define HIT_Y 2
+#define HIT_Z 4
+
+#define COLLIDE_SKIN 0.001f // boxes touching a block closer than this touch it
+
+/*
+ * Moving boxes: center, velocity (blocks/sec) and half extents, one array
+ * per component and axis.
+ */
+typedef struct BodiesTag
+{
+    float* p[3]; // centers
+    float* v[3]; // velocities
+    float* half[3]; // half extents
+    unsigned char* hits; // HIT_* of the last step
+    int count;
+    int capacity;
+} Bodies;
+
+/*
+ * Construct an empty set of bodies.
+ *
+ * @capacity: number of bodies to make room for, it grows as needed.
+ */
+Bodies* construct_bodies(int capacity);
+
+/*
+ * Free a set of bodies.
+ */
+void destroy_bodies(Bodies* bodies);
+
+/*
+ * Add a body and get its index.
+ *
+ * @p: center (x, y, z).
+ * @half: half extents (x, y, z).
+ * @v: velocity (x, y, z).
+ */
+int bodies_add(Bodies* bodies, const float* p, const float* half,
+               const float* v);
+
+/*
+ * Remove a body. The last body takes its index.
+ */
+void bodies_remove(Bodies* bodies, int idx);
+
+/*
+ * Move every body by its velocity for @dt seconds. Velocity components of
+ * the axes a body was stopped on are zeroed.
+ */
+void bodies_step(const World* world, Bodies* bodies, float dt);
+
+/*
+ * Move a single box by @d, stopping at solid blocks. Returns the HIT_* of
+ * the axes it was stopped on.
+ *
+ * @p: center of the box (x, y, z). Will be updated.
+ * @half: half extents of the box (x, y, z).
+ * @d: displacement (x, y, z).
+ */
+int collide_box(const World* world, float* p, const float* half,
+                const float* d);
+
+/*
+ * Check if the block at block coordinates @x, @y, @z is solid.
+ */
+int world_solid(const World* world, int x, int y, int z);
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * Implementation of the column cache.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "column.h"
+
+static Column* buckets[COLUMN_BUCKETS];
+static int count = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t filled = PTHREAD_COND_INITIALIZER;
+
+static unsigned int bucket_of(int cx, int cz)
+{
+    return (((unsigned int)cx * 73856093u) ^ ((unsigned int)cz * 83492791u)) %
+           COLUMN_BUCKETS;
+}
+
+Column* column_acquire(int cx, int cz, ColumnFill fill)
+{
+    Column* column;
+    unsigned int bucket = bucket_of(cx, cz);
+
+    pthread_mutex_lock(&lock);
+    for (column = buckets[bucket]; column != NULL; column = column->next)
+    {
+        if (column->c[0] == cx && column->c[1] == cz)
+        {
+            break;
+        }
+    }
+    if (column == NULL)
+    {
+        column = malloc(sizeof(Column));
+        column->c[0] = cx;
+        column->c[1] = cz;
+        column->state = COLUMN_EMPTY;
+        column->refs = 0;
+        column->next = buckets[bucket];
+        buckets[bucket] = column;
+        count++;
+    }
+    column->refs++;
+
+    if (column->state == COLUMN_EMPTY)
+    {
+        // ours to fill, without holding up everyone else
+        column->state = COLUMN_FILLING;
+        pthread_mutex_unlock(&lock);
+        fill(column);
+        pthread_mutex_lock(&lock);
+        column->state = COLUMN_READY;
+        pthread_cond_broadcast(&filled);
+    }
+    while (column->state != COLUMN_READY)
+    {
+        pthread_cond_wait(&filled, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+    return column;
+}
+
+void column_release(Column* column)
+{
+    Column** link;
+
+    pthread_mutex_lock(&lock);
+    if (--column->refs > 0)
+    {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    link = &buckets[bucket_of(column->c[0], column->c[1])];
+    while (*link != column)
+    {
+        link = &(*link)->next;
+    }
+    *link = column->next;
+    count--;
+    pthread_mutex_unlock(&lock);
+    free(column);
+}
+
+int column_count()
+{
+    int result;
+
+    pthread_mutex_lock(&lock);
+    result = count;
+    pthread_mutex_unlock(&lock);
+    return result;
+}
@@ -0,0 +1,61 @@
+/*
+ * Columns: the 2D generation fields (height, biome, climate) of a 16x16
+ * footprint, shared by every chunk stacked above it.
+ *
+ * A column is computed once, by whichever generator asks for it first.
+ * Generators asking for a column that is being computed wait for it
+ * instead of computing it again. Each chunk holds a reference to its
+ * column, and a column is freed with the last chunk that uses it.
+ *
+ * Safe to use from any thread.
+ */
+
+#ifndef COLUMN_H
+#define COLUMN_H
+
+#include "chunk.h"
+
+#define COLUMN_BUCKETS 1024 // hash buckets of the column table
+
+// column states
+#define COLUMN_EMPTY 0
+#define COLUMN_FILLING 1
+#define COLUMN_READY 2
+
+typedef struct ColumnTag
+{
+    int c[2]; // chunk x, z
+    int state; // COLUMN_*
+    int refs;
+    short height[CHUNK_SIZE][CHUNK_SIZE]; // y of the topmost solid block
+    int min_height; // lowest of @height
+    int max_height; // highest of @height
+    unsigned char biome[CHUNK_SIZE][CHUNK_SIZE]; // BIOME_*, see terrain.h
+    float temperature[CHUNK_SIZE][CHUNK_SIZE]; // climate, [-1, 1]
+    float humidity[CHUNK_SIZE][CHUNK_SIZE]; // climate, [-1, 1]
+    struct ColumnTag* next; // next in bucket
+} Column;
+
+/*
+ * Computes the fields of a column from its coordinates.
+ */
+typedef void (*ColumnFill)(Column* column);
+
+/*
+ * Get the column at chunk coordinates @cx, @cz with its fields computed,
+ * calling @fill if no one did yet. Takes a reference the caller gives back
+ * with column_release().
+ */
+Column* column_acquire(int cx, int cz, ColumnFill fill);
+
+/*
+ * Give back a reference to a column, freeing it if it was the last one.
+ */
+void column_release(Column* column);
+
+/*
+ * Get the number of columns in memory.
+ */
+int column_count();
+
+#endif
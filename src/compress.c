@@ -0,0 +1,70 @@
+/*
+ * Implementation of run-length coding of block id grids.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "compress.h"
+
+int rle_encode(const unsigned char* in, int count, unsigned char** out)
+{
+    unsigned char* packed;
+    int size = 0;
+    int start = 0;
+    int end;
+
+    // worst case: every byte differs from the last
+    packed = malloc(2 * count);
+    while (start < count)
+    {
+        end = start + 1;
+        while (end < count && end - start < RLE_MAX_RUN &&
+               in[end] == in[start])
+        {
+            end++;
+        }
+        packed[size++] = (unsigned char)(end - start - 1);
+        packed[size++] = in[start];
+        start = end;
+    }
+
+    *out = realloc(packed, size > 0 ? size : 1);
+    return size;
+}
+
+int rle_decode(const unsigned char* in, int size, unsigned char* out,
+               int count)
+{
+    int written = 0;
+    int run;
+    int idx;
+
+    for (idx = 0; idx + 1 < size; idx += 2)
+    {
+        run = in[idx] + 1;
+        if (written + run > count)
+        {
+            return -1;
+        }
+        memset(out + written, in[idx + 1], run);
+        written += run;
+    }
+    return (idx == size) ? written : -1;
+}
+
+int rle_lookup(const unsigned char* in, int size, int idx)
+{
+    int offset;
+    int start = 0;
+
+    for (offset = 0; offset + 1 < size; offset += 2)
+    {
+        start += in[offset] + 1;
+        if (idx < start)
+        {
+            return in[offset + 1];
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,33 @@
+/*
+ * Run-length coding of block id grids.
+ *
+ * A packed grid is a list of (run length - 1, id) byte pairs, so runs are
+ * at most 256 blocks long. An all-air chunk packs into 32 bytes.
+ */
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#define RLE_MAX_RUN 256
+
+/*
+ * Pack @count bytes of @in. Returns the packed size, @out is malloc'ed and
+ * owned by the caller.
+ */
+int rle_encode(const unsigned char* in, int count, unsigned char** out);
+
+/*
+ * Unpack @size bytes of @in into @out, which has room for @count bytes.
+ * Returns the number of bytes written, -1 if @in is malformed or does not
+ * fit in @out.
+ */
+int rle_decode(const unsigned char* in, int size, unsigned char* out,
+               int count);
+
+/*
+ * Get the byte at @idx of a packed grid without unpacking it. Returns 0
+ * (air) if @idx is past the end.
+ */
+int rle_lookup(const unsigned char* in, int size, int idx);
+
+#endif
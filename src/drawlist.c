@@ -0,0 +1,93 @@
+/*
+ * Implementation of draw lists.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drawlist.h"
+
+#define MIN_CAPACITY 64
+
+DrawList* construct_draw_list()
+{
+    DrawList* new_list;
+
+    new_list = malloc(sizeof(DrawList));
+    new_list->chunks = NULL;
+    new_list->count = 0;
+    new_list->capacity = 0;
+    new_list->scratch = NULL;
+    new_list->keys = NULL;
+    return new_list;
+}
+
+void destroy_draw_list(DrawList* list)
+{
+    free(list->chunks);
+    free(list->scratch);
+    free(list->keys);
+    free(list);
+}
+
+void draw_list_clear(DrawList* list)
+{
+    list->count = 0;
+}
+
+void draw_list_add(DrawList* list, Chunk* chunk)
+{
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? 2 * list->capacity : MIN_CAPACITY;
+        list->chunks = realloc(list->chunks,
+                               list->capacity * sizeof(Chunk*));
+        list->scratch = realloc(list->scratch,
+                                list->capacity * sizeof(Chunk*));
+        list->keys = realloc(list->keys, list->capacity);
+    }
+    list->chunks[list->count++] = chunk;
+}
+
+void draw_list_sort(DrawList* list, const float* p)
+{
+    Chunk** swap;
+    float d[3];
+    float bucket;
+    int idx;
+    int total;
+    int count;
+
+    // bucket each chunk by the distance of its centre
+    memset(list->counts, 0, sizeof(list->counts));
+    for (idx = 0; idx < list->count; idx++)
+    {
+        // a chunk spans x a..a+16, y a-1..a+15, z a-1..a+15
+        d[0] = list->chunks[idx]->a[0] + CHUNK_SIZE * 0.5f - p[0];
+        d[1] = list->chunks[idx]->a[1] + CHUNK_SIZE * 0.5f - 1.0f - p[1];
+        d[2] = list->chunks[idx]->a[2] + CHUNK_SIZE * 0.5f - 1.0f - p[2];
+        bucket = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) /
+                 DRAW_BUCKET_SIZE;
+        list->keys[idx] = (unsigned char)((bucket < DRAW_BUCKETS - 1) ?
+                                          bucket : DRAW_BUCKETS - 1);
+        list->counts[list->keys[idx]]++;
+    }
+
+    // counts -> first position of each bucket
+    total = 0;
+    for (idx = 0; idx < DRAW_BUCKETS; idx++)
+    {
+        count = list->counts[idx];
+        list->counts[idx] = total;
+        total += count;
+    }
+
+    for (idx = 0; idx < list->count; idx++)
+    {
+        list->scratch[list->counts[list->keys[idx]]++] = list->chunks[idx];
+    }
+    swap = list->chunks;
+    list->chunks = list->scratch;
+    list->scratch = swap;
+}
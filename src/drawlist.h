@@ -0,0 +1,57 @@
+/*
+ * The chunks drawn in a frame, ordered front to back.
+ *
+ * Drawing near chunks first lets the depth test reject the fragments of
+ * everything they cover before it is shaded. Chunks are ordered by the
+ * distance of their centres from the camera with a counting sort over
+ * DRAW_BUCKETS buckets of DRAW_BUCKET_SIZE blocks, which is linear in the
+ * number of chunks. Chunks in the same bucket keep the order they were
+ * added in. The buffers are kept across frames, so a list that is
+ * cleared and refilled every frame stops allocating once it has grown.
+ */
+
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include "chunk.h"
+
+#define DRAW_BUCKETS 256
+#define DRAW_BUCKET_SIZE 2.0f // blocks of distance per bucket
+
+typedef struct DrawListTag
+{
+    Chunk** chunks; // front to back once sorted
+    int count;
+    int capacity;
+    Chunk** scratch; // @capacity entries, for sorting
+    unsigned char* keys; // @capacity entries, bucket of each chunk
+    int counts[DRAW_BUCKETS];
+} DrawList;
+
+/*
+ * Construct an empty draw list.
+ */
+DrawList* construct_draw_list();
+
+/*
+ * Free a draw list. Does not free its chunks.
+ */
+void destroy_draw_list(DrawList* list);
+
+/*
+ * Empty a draw list, keeping its buffers.
+ */
+void draw_list_clear(DrawList* list);
+
+/*
+ * Append a chunk to a draw list.
+ */
+void draw_list_add(DrawList* list, Chunk* chunk);
+
+/*
+ * Order a draw list front to back as seen from @p. Chunks farther than
+ * DRAW_BUCKETS * DRAW_BUCKET_SIZE blocks all go last.
+ */
+void draw_list_sort(DrawList* list, const float* p);
+
+#endif
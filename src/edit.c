@@ -0,0 +1,549 @@
+/*
+ * Implementation of bulk edits.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "edit.h"
+#include "compress.h"
+#include "faces.h"
+#include "jobs.h"
+#include "meshcache.h"
+#include "residency.h"
+
+#define BYTE_LOW_BITS 0x0101010101010101ULL // lowest bit of every byte
+
+/*
+ * Writes the blocks z0..z1 (inclusive, world coordinates) of the z row at
+ * world @x, @y. @row is the chunk's whole row, starting at z = @zbase.
+ */
+typedef void (*RowFunc)(unsigned char* row, int zbase, int x, int y, int z0,
+                        int z1, const void* arg);
+
+typedef struct SphereTag
+{
+    float c[3];
+    float outer2; // squared outer radius
+    float inner2; // squared inner radius, negative if solid
+    int id;
+} Sphere;
+
+typedef struct PasteTag
+{
+    const Region* region;
+    const int* at;
+    int skip_air;
+} Paste;
+
+static void sort_box(const int* a, const int* b, int* lo, int* hi)
+{
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        lo[i] = (a[i] < b[i]) ? a[i] : b[i];
+        hi[i] = (a[i] < b[i]) ? b[i] : a[i];
+    }
+}
+
+/*
+ * Let the jobs reading a chunk finish.
+ */
+static void wait_for_jobs(Chunk* chunk)
+{
+    int stage;
+
+    for (stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        if (chunk->jobs[stage] && !job_done(chunk->jobs[stage]))
+        {
+            job_wait(chunk->jobs[stage]);
+        }
+    }
+}
+
+/*
+ * XOR @ids into @old eight blocks at a time. Returns the number of blocks
+ * that differ.
+ */
+static long xor_ids(unsigned char* old, const unsigned char* ids)
+{
+    unsigned long long a;
+    unsigned long long b;
+    long changed = 0;
+    int i;
+
+    for (i = 0; i < BLOCKS_PER_CHUNK; i += sizeof(a))
+    {
+        memcpy(&a, old + i, sizeof(a));
+        memcpy(&b, ids + i, sizeof(b));
+        a ^= b;
+        memcpy(old + i, &a, sizeof(a));
+        if (a)
+        {
+            // fold every byte onto its lowest bit and count the bytes
+            a |= a >> 4;
+            a |= a >> 2;
+            a |= a >> 1;
+            changed += __builtin_popcountll(a & BYTE_LOW_BITS);
+        }
+    }
+    return changed;
+}
+
+/*
+ * Bring a chunk's summary and render data up to date after its ids
+ * changed.
+ */
+static void chunk_changed(Chunk* chunk)
+{
+    chunk_update_solid(chunk);
+    chunk->edits++;
+    chunk->modified = 1;
+    if (chunk->render_path == RENDER_PATH_FACES && chunk->faces)
+    {
+        face_buffer_build(chunk->faces, chunk);
+    }
+    else
+    {
+        chunk->dirty = 1; // one remesh, however many blocks changed
+    }
+}
+
+static void free_record(EditJournal* journal, EditRecord* record)
+{
+    int idx;
+
+    for (idx = 0; idx < record->count; idx++)
+    {
+        journal->bytes -= record->diffs[idx].packed_size;
+        free(record->diffs[idx].packed);
+    }
+    free(record->diffs);
+}
+
+static EditRecord* begin_record(EditJournal* journal)
+{
+    EditRecord* record;
+
+    if (journal->count == journal->capacity)
+    {
+        journal->capacity = journal->capacity ? journal->capacity * 2 : 16;
+        journal->records = realloc(journal->records,
+                                   journal->capacity * sizeof(EditRecord));
+    }
+    record = &journal->records[journal->count++];
+    record->diffs = NULL;
+    record->count = 0;
+    record->capacity = 0;
+    return record;
+}
+
+static void end_record(EditJournal* journal)
+{
+    EditRecord* record = &journal->records[journal->count - 1];
+
+    if (record->count == 0)
+    {
+        free(record->diffs);
+        journal->count--;
+        return;
+    }
+
+    // keep the latest edit even if it alone is over the limit
+    while (journal->bytes > EDIT_JOURNAL_BYTES && journal->count > 1)
+    {
+        free_record(journal, &journal->records[0]);
+        journal->count--;
+        memmove(journal->records, journal->records + 1,
+                journal->count * sizeof(EditRecord));
+    }
+}
+
+static void add_diff(EditJournal* journal, EditRecord* record,
+                     const Chunk* chunk, const unsigned char* diff)
+{
+    ChunkDiff* entry;
+    int i;
+
+    if (record->count == record->capacity)
+    {
+        record->capacity = record->capacity ? record->capacity * 2 : 8;
+        record->diffs = realloc(record->diffs,
+                                record->capacity * sizeof(ChunkDiff));
+    }
+    entry = &record->diffs[record->count++];
+    for (i = 0; i < 3; i++)
+    {
+        entry->c[i] = chunk_coord(chunk->a[i]);
+    }
+    entry->packed_size = rle_encode(diff, BLOCKS_PER_CHUNK, &entry->packed);
+    entry->after = xxh64(chunk->ids, BLOCKS_PER_CHUNK, 0);
+    journal->bytes += entry->packed_size;
+}
+
+/*
+ * Run @func over the rows of box @lo..@hi that lie in @chunk, then update
+ * the chunk and record what changed. Returns the number of blocks changed.
+ */
+static long edit_chunk(EditJournal* journal, Chunk* chunk, const int* lo,
+                       const int* hi, RowFunc func, const void* arg)
+{
+    unsigned char old[BLOCKS_PER_CHUNK];
+    int from[3];
+    int to[3];
+    int dx;
+    int dy;
+    int i;
+    long changed;
+
+    for (i = 0; i < 3; i++)
+    {
+        from[i] = (lo[i] > chunk->a[i]) ? lo[i] - chunk->a[i] : 0;
+        to[i] = (hi[i] < chunk->a[i] + CHUNK_SIZE - 1) ? hi[i] - chunk->a[i]
+                                                       : CHUNK_SIZE - 1;
+    }
+
+    wait_for_jobs(chunk);
+    chunk_touch(chunk);
+    memcpy(old, chunk->ids, BLOCKS_PER_CHUNK);
+    for (dx = from[0]; dx <= to[0]; dx++)
+    {
+        for (dy = from[1]; dy <= to[1]; dy++)
+        {
+            func((chunk->ids)[dx][dy], chunk->a[2], chunk->a[0] + dx,
+                 chunk->a[1] + dy, chunk->a[2] + from[2],
+                 chunk->a[2] + to[2], arg);
+        }
+    }
+
+    changed = xor_ids(old, (const unsigned char*)chunk->ids);
+    if (changed == 0)
+    {
+        return 0;
+    }
+    if (journal)
+    {
+        add_diff(journal, &journal->records[journal->count - 1], chunk, old);
+    }
+    chunk_changed(chunk);
+    return changed;
+}
+
+/*
+ * Run @func over every row of the box @min..@max, chunk by chunk.
+ */
+static long edit_box(World* world, EditJournal* journal, const int* min,
+                     const int* max, RowFunc func, const void* arg)
+{
+    Chunk* chunk;
+    int lo[3];
+    int hi[3];
+    int cx;
+    int cy;
+    int cz;
+    long changed = 0;
+
+    sort_box(min, max, lo, hi);
+    if (journal)
+    {
+        begin_record(journal);
+    }
+    for (cx = chunk_coord(lo[0]); cx <= chunk_coord(hi[0]); cx++)
+    {
+        for (cy = chunk_coord(lo[1]); cy <= chunk_coord(hi[1]); cy++)
+        {
+            for (cz = chunk_coord(lo[2]); cz <= chunk_coord(hi[2]); cz++)
+            {
+                chunk = world_get(world, cx, cy, cz);
+                if (chunk == NULL ||
+                    !__atomic_load_n(&chunk->solid_ready, __ATOMIC_ACQUIRE))
+                {
+                    continue; // not there to edit
+                }
+                changed += edit_chunk(journal, chunk, lo, hi, func, arg);
+            }
+        }
+    }
+    if (journal)
+    {
+        end_record(journal);
+    }
+    return changed;
+}
+
+static void fill_span(unsigned char* row, int zbase, int z0, int z1, int id)
+{
+    if (z0 <= z1)
+    {
+        memset(row + z0 - zbase, id, z1 - z0 + 1);
+    }
+}
+
+static void fill_row(unsigned char* row, int zbase, int x, int y, int z0,
+                     int z1, const void* arg)
+{
+    fill_span(row, zbase, z0, z1, *(const int*)arg);
+}
+
+static void replace_row(unsigned char* row, int zbase, int x, int y, int z0,
+                        int z1, const void* arg)
+{
+    const int* ids = arg; // from, to
+    int z;
+
+    for (z = z0 - zbase; z <= z1 - zbase; z++)
+    {
+        if (row[z] == ids[0])
+        {
+            row[z] = (unsigned char)ids[1];
+        }
+    }
+}
+
+static void sphere_row(unsigned char* row, int zbase, int x, int y, int z0,
+                       int z1, const void* arg)
+{
+    const Sphere* sphere = arg;
+    float fx = x + 0.5f - sphere->c[0]; // block centres
+    float fy = y - 0.5f - sphere->c[1];
+    float mid = sphere->c[2] + 0.5f; // z of the block centred on c[2]
+    float d2 = fx * fx + fy * fy;
+    float half;
+    int s0;
+    int s1;
+    int i0;
+    int i1;
+
+    if (d2 > sphere->outer2)
+    {
+        return;
+    }
+    half = sqrtf(sphere->outer2 - d2);
+    s0 = (int)ceilf(mid - half);
+    s1 = (int)floorf(mid + half);
+    s0 = (s0 > z0) ? s0 : z0;
+    s1 = (s1 < z1) ? s1 : z1;
+    if (d2 > sphere->inner2)
+    {
+        fill_span(row, zbase, s0, s1, sphere->id);
+        return;
+    }
+
+    // two spans, around the hollow
+    half = sqrtf(sphere->inner2 - d2);
+    i0 = (int)ceilf(mid - half);
+    i1 = (int)floorf(mid + half);
+    fill_span(row, zbase, s0, (i0 - 1 < s1) ? i0 - 1 : s1, sphere->id);
+    fill_span(row, zbase, (i1 + 1 > s0) ? i1 + 1 : s0, s1, sphere->id);
+}
+
+static void paste_row(unsigned char* row, int zbase, int x, int y, int z0,
+                      int z1, const void* arg)
+{
+    const Paste* paste = arg;
+    const Region* region = paste->region;
+    const unsigned char* src;
+    int z;
+
+    src = region->ids + ((x - paste->at[0]) * region->size[1] +
+                         (y - paste->at[1])) * region->size[2] +
+          (z0 - paste->at[2]);
+    if (!paste->skip_air)
+    {
+        memcpy(row + z0 - zbase, src, z1 - z0 + 1);
+        return;
+    }
+    for (z = 0; z <= z1 - z0; z++)
+    {
+        if (src[z] != BLOCK_AIR)
+        {
+            row[z0 - zbase + z] = src[z];
+        }
+    }
+}
+
+EditJournal* construct_edit_journal()
+{
+    EditJournal* journal = malloc(sizeof(EditJournal));
+
+    journal->records = NULL;
+    journal->count = 0;
+    journal->capacity = 0;
+    journal->bytes = 0;
+    return journal;
+}
+
+void destroy_edit_journal(EditJournal* journal)
+{
+    int idx;
+
+    for (idx = 0; idx < journal->count; idx++)
+    {
+        free_record(journal, &journal->records[idx]);
+    }
+    free(journal->records);
+    free(journal);
+}
+
+long edit_fill(World* world, EditJournal* journal, const int* min,
+               const int* max, int id)
+{
+    return edit_box(world, journal, min, max, fill_row, &id);
+}
+
+long edit_hollow_sphere(World* world, EditJournal* journal,
+                        const float* center, float radius, float thickness,
+                        int id)
+{
+    Sphere sphere;
+    int min[3];
+    int max[3];
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        sphere.c[i] = center[i];
+    }
+    sphere.outer2 = radius * radius;
+    sphere.inner2 = (thickness < radius) ? (radius - thickness) *
+                                           (radius - thickness) : -1.0f;
+    sphere.id = id;
+
+    // block x covers x..x+1, y covers y-1..y and z covers z-1..z
+    min[0] = (int)floorf(center[0] - radius);
+    max[0] = (int)ceilf(center[0] + radius);
+    min[1] = (int)floorf(center[1] - radius);
+    max[1] = (int)ceilf(center[1] + radius) + 1;
+    min[2] = (int)floorf(center[2] - radius);
+    max[2] = (int)ceilf(center[2] + radius) + 1;
+    return edit_box(world, journal, min, max, sphere_row, &sphere);
+}
+
+long edit_replace(World* world, EditJournal* journal, const int* min,
+                  const int* max, int from, int to)
+{
+    int ids[2] = {from, to};
+
+    return edit_box(world, journal, min, max, replace_row, ids);
+}
+
+Region* edit_copy(World* world, const int* min, const int* max)
+{
+    Region* region = malloc(sizeof(Region));
+    Chunk* chunk;
+    int lo[3];
+    int hi[3];
+    int i;
+    int x;
+    int y;
+    int z0;
+    int z1;
+
+    sort_box(min, max, lo, hi);
+    for (i = 0; i < 3; i++)
+    {
+        region->size[i] = hi[i] - lo[i] + 1;
+    }
+    region->ids = calloc((size_t)region->size[0] * region->size[1] *
+                         region->size[2], 1);
+
+    // one z row at a time, split where it crosses chunks
+    for (x = lo[0]; x <= hi[0]; x++)
+    {
+        for (y = lo[1]; y <= hi[1]; y++)
+        {
+            for (z0 = lo[2]; z0 <= hi[2]; z0 = z1 + 1)
+            {
+                z1 = (chunk_coord(z0) + 1) * CHUNK_SIZE - 1;
+                z1 = (z1 < hi[2]) ? z1 : hi[2];
+                chunk = world_get(world, chunk_coord(x), chunk_coord(y),
+                                  chunk_coord(z0));
+                if (chunk == NULL ||
+                    !__atomic_load_n(&chunk->solid_ready, __ATOMIC_ACQUIRE))
+                {
+                    continue; // air
+                }
+                chunk_touch(chunk);
+                memcpy(region->ids + ((x - lo[0]) * region->size[1] +
+                                      (y - lo[1])) * region->size[2] +
+                           (z0 - lo[2]),
+                       &(chunk->ids)[x - chunk->a[0]][y - chunk->a[1]]
+                                    [z0 - chunk->a[2]],
+                       z1 - z0 + 1);
+            }
+        }
+    }
+    return region;
+}
+
+void destroy_region(Region* region)
+{
+    free(region->ids);
+    free(region);
+}
+
+long edit_paste(World* world, EditJournal* journal, const Region* region,
+                const int* at, int skip_air)
+{
+    Paste paste;
+    int max[3];
+    int i;
+
+    paste.region = region;
+    paste.at = at;
+    paste.skip_air = skip_air;
+    for (i = 0; i < 3; i++)
+    {
+        max[i] = at[i] + region->size[i] - 1;
+    }
+    return edit_box(world, journal, at, max, paste_row, &paste);
+}
+
+int edit_undo(World* world, EditJournal* journal)
+{
+    unsigned char diff[BLOCKS_PER_CHUNK];
+    EditRecord* record;
+    ChunkDiff* entry;
+    Chunk* chunk;
+    int idx;
+    int stale = 0;
+
+    if (journal->count == 0)
+    {
+        return 0;
+    }
+    record = &journal->records[journal->count - 1];
+    for (idx = 0; idx < record->count; idx++)
+    {
+        entry = &record->diffs[idx];
+        chunk = world_get(world, entry->c[0], entry->c[1], entry->c[2]);
+        if (chunk == NULL ||
+            rle_decode(entry->packed, entry->packed_size, diff,
+                       BLOCKS_PER_CHUNK) != BLOCKS_PER_CHUNK)
+        {
+            continue;
+        }
+        wait_for_jobs(chunk);
+        chunk_touch(chunk);
+        if (xxh64(chunk->ids, BLOCKS_PER_CHUNK, 0) != entry->after)
+        {
+            stale++; // the XOR would scramble the newer blocks
+            continue;
+        }
+        xor_ids(diff, (const unsigned char*)chunk->ids);
+        memcpy(chunk->ids, diff, BLOCKS_PER_CHUNK);
+        chunk_changed(chunk);
+    }
+    if (stale > 0)
+    {
+        fprintf(stderr, "Undo skipped %d chunks changed since the edit.\n",
+                stale);
+    }
+    free_record(journal, record);
+    journal->count--;
+    return 1;
+}
@@ -0,0 +1,138 @@
+/*
+ * Bulk edits: fill a box, carve a hollow sphere, replace one block type
+ * with another, copy and paste regions.
+ *
+ * A bulk edit splits its region into the chunks it touches and writes each
+ * chunk's z rows in whole spans (memset/memcpy) instead of block by block.
+ * Each touched chunk gets its solidity summary rebuilt once and is marked
+ * dirty once, so the draw loop remeshes it once however many blocks
+ * changed.
+ *
+ * Every edit can be recorded in a journal for undo. Per changed chunk the
+ * journal keeps old ids XOR new ids, run-length coded (see compress.h).
+ * That is mostly zeros and packs into a few bytes. Undoing applies the
+ * same XOR again. That only restores the old ids if the chunk still holds
+ * what the edit left, so the journal also keeps a hash of those ids, and
+ * chunks changed since by anything else are not undone.
+ *
+ * Chunks that are not loaded or not generated yet are left alone. Edits
+ * wait for jobs still reading a chunk. Everything here runs on the main
+ * thread.
+ */
+
+#ifndef EDIT_H
+#define EDIT_H
+
+#include "world.h"
+
+#define EDIT_JOURNAL_BYTES (16 * 1024 * 1024) // oldest edits dropped beyond
+
+/*
+ * Change of one chunk by one edit.
+ */
+typedef struct ChunkDiffTag
+{
+    int c[3]; // chunk coordinates
+    unsigned char* packed; // old ids XOR new ids, run-length coded
+    int packed_size;
+    unsigned long long after; // xxh64() of the ids the edit left
+} ChunkDiff;
+
+/*
+ * One bulk edit: the chunks it changed.
+ */
+typedef struct EditRecordTag
+{
+    ChunkDiff* diffs;
+    int count;
+    int capacity;
+} EditRecord;
+
+typedef struct EditJournalTag
+{
+    EditRecord* records; // oldest first
+    int count;
+    int capacity;
+    long bytes; // size of all diffs
+} EditJournal;
+
+/*
+ * A box of block ids cut out of the world.
+ */
+typedef struct RegionTag
+{
+    int size[3];
+    unsigned char* ids; // [x][y][z], z fastest
+} Region;
+
+/*
+ * Construct an empty journal.
+ */
+EditJournal* construct_edit_journal();
+
+/*
+ * Free a journal.
+ */
+void destroy_edit_journal(EditJournal* journal);
+
+/*
+ * Set every block in a box to @id. Returns the number of blocks changed.
+ *
+ * @journal: records the edit for undo, NULL if not needed.
+ * @min, @max: opposite corners of the box (x, y, z), inclusive.
+ */
+long edit_fill(World* world, EditJournal* journal, const int* min,
+               const int* max, int id);
+
+/*
+ * Set every block of a spherical shell to @id. A block belongs to the
+ * shell if its centre is at most @radius and more than @radius -
+ * @thickness away from @center. Returns the number of blocks changed.
+ *
+ * @journal: records the edit for undo, NULL if not needed.
+ */
+long edit_hollow_sphere(World* world, EditJournal* journal,
+                        const float* center, float radius, float thickness,
+                        int id);
+
+/*
+ * Set every block in a box that is @from to @to. Returns the number of
+ * blocks changed.
+ *
+ * @journal: records the edit for undo, NULL if not needed.
+ * @min, @max: opposite corners of the box (x, y, z), inclusive.
+ */
+long edit_replace(World* world, EditJournal* journal, const int* min,
+                  const int* max, int from, int to);
+
+/*
+ * Copy the blocks in a box. Blocks of chunks that are not loaded read as
+ * air.
+ *
+ * @min, @max: opposite corners of the box (x, y, z), inclusive.
+ */
+Region* edit_copy(World* world, const int* min, const int* max);
+
+/*
+ * Free a region.
+ */
+void destroy_region(Region* region);
+
+/*
+ * Write a region into the world with its first corner at @at. Returns the
+ * number of blocks changed.
+ *
+ * @journal: records the edit for undo, NULL if not needed.
+ * @skip_air: leave the world alone where the region has air.
+ */
+long edit_paste(World* world, EditJournal* journal, const Region* region,
+                const int* at, int skip_air);
+
+/*
+ * Undo the latest edit of a journal and forget it. Returns 0 if there was
+ * nothing to undo. Chunks unloaded or changed since the edit are skipped,
+ * and the changed ones reported.
+ */
+int edit_undo(World* world, EditJournal* journal);
+
+#endif
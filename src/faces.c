@@ -0,0 +1,290 @@
+/*
+ * Implementation of the instanced per-face render path.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "faces.h"
+
+#define SLOT(dx, dy, dz, dir) \
+    ((((dx) * CHUNK_SIZE + (dy)) * CHUNK_SIZE + (dz)) * DIR_COUNT + (dir))
+#define MIN_RECORDS 256
+
+static GLuint quad_buffer_id;
+static GLint corner_attrib;
+static GLint face_attrib;
+
+/*
+ * Opposite of each DIR_*.
+ */
+static const int opposite[DIR_COUNT] = {
+    DIR_SOUTH, DIR_NORTH, DIR_WEST, DIR_EAST, DIR_DOWN, DIR_UP
+};
+
+/*
+ * Slot of a packed record, so a moved record can find its slot again.
+ */
+static int record_slot(GLuint record)
+{
+    return SLOT(record & 0xf, (record >> 4) & 0xf, (record >> 8) & 0xf,
+                (record >> 12) & 0x7);
+}
+
+static void mark_dirty(FaceBuffer* buffer, int idx)
+{
+    if (idx < buffer->dirty_lo)
+    {
+        buffer->dirty_lo = idx;
+    }
+    if (idx + 1 > buffer->dirty_hi)
+    {
+        buffer->dirty_hi = idx + 1;
+    }
+}
+
+/*
+ * Add, retile or remove (@tile < 0) the record of one block face.
+ */
+static void face_set(FaceBuffer* buffer, int dx, int dy, int dz, int dir,
+                     int tile)
+{
+    int slot = SLOT(dx, dy, dz, dir);
+    int idx = (int)buffer->slots[slot] - 1;
+    int last;
+
+    if (tile < 0)
+    {
+        if (idx < 0)
+        {
+            return;
+        }
+        // swap-remove: move the last record into the hole
+        last = buffer->count - 1;
+        if (idx != last)
+        {
+            buffer->records[idx] = buffer->records[last];
+            buffer->slots[record_slot(buffer->records[idx])] =
+                (unsigned short)(idx + 1);
+            mark_dirty(buffer, idx);
+        }
+        buffer->slots[slot] = 0;
+        buffer->count--;
+        return;
+    }
+
+    if (idx < 0)
+    {
+        if (buffer->count == buffer->capacity)
+        {
+            buffer->capacity *= 2;
+            buffer->records = realloc(buffer->records,
+                                      buffer->capacity * sizeof(GLuint));
+        }
+        idx = buffer->count++;
+        buffer->slots[slot] = (unsigned short)(idx + 1);
+    }
+    buffer->records[idx] = face_pack(dx, dy, dz, dir, tile);
+    mark_dirty(buffer, idx);
+}
+
+/*
+ * Recompute the face of the block at @dx, @dy, @dz pointing in @dir.
+ */
+static void face_refresh(FaceBuffer* buffer, const Chunk* chunk,
+                         int dx, int dy, int dz, int dir)
+{
+    int id = get_block(chunk, dx, dy, dz);
+    int exposed = get_block(chunk,
+                            dx + DIR_OFFSETS[dir][0],
+                            dy + DIR_OFFSETS[dir][1],
+                            dz + DIR_OFFSETS[dir][2]) == BLOCK_AIR;
+
+    face_set(buffer, dx, dy, dz, dir,
+             (id != BLOCK_AIR && exposed) ? block_tile(id) : -1);
+}
+
+void faces_init(GLint corner_attrib_idx, GLint face_attrib_idx)
+{
+    // two triangles, corners in face space
+    const GLfloat quad[12] = {
+        0.0f, 0.0f,  1.0f, 0.0f,  0.0f, 1.0f,
+        1.0f, 1.0f,  0.0f, 1.0f,  1.0f, 0.0f,
+    };
+
+    corner_attrib = corner_attrib_idx;
+    face_attrib = face_attrib_idx;
+
+    glGenBuffers(1, &quad_buffer_id);
+    glBindBuffer(GL_ARRAY_BUFFER, quad_buffer_id);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+GLuint face_pack(int dx, int dy, int dz, int dir, int tile)
+{
+    return (GLuint)(dx & 0xf) |
+           ((GLuint)(dy & 0xf) << 4) |
+           ((GLuint)(dz & 0xf) << 8) |
+           ((GLuint)(dir & 0x7) << 12) |
+           ((GLuint)(tile & 0xff) << 16);
+}
+
+int block_tile(int id)
+{
+    switch (id)
+    {
+        case BLOCK_DIRT:
+        default:
+            return 14 * ATLAS_TILES + 0; // see comp_block_texture_data()
+    }
+}
+
+FaceBuffer* construct_face_buffer()
+{
+    FaceBuffer* new_buffer;
+
+    new_buffer = malloc(sizeof(FaceBuffer));
+    new_buffer->capacity = MIN_RECORDS;
+    new_buffer->records = malloc(new_buffer->capacity * sizeof(GLuint));
+    new_buffer->slots = calloc(FACES_PER_CHUNK, sizeof(unsigned short));
+    new_buffer->count = 0;
+    new_buffer->gpu_capacity = 0;
+    new_buffer->dirty_lo = FACES_PER_CHUNK;
+    new_buffer->dirty_hi = 0;
+
+    glGenVertexArrays(1, &new_buffer->vertex_array_id);
+    glBindVertexArray(new_buffer->vertex_array_id);
+
+    // shared quad, one corner per vertex
+    glBindBuffer(GL_ARRAY_BUFFER, quad_buffer_id);
+    glVertexAttribPointer(corner_attrib, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    glEnableVertexAttribArray(corner_attrib);
+
+    // face records, one per instance
+    glGenBuffers(1, &new_buffer->face_buffer_id);
+    glBindBuffer(GL_ARRAY_BUFFER, new_buffer->face_buffer_id);
+    glVertexAttribIPointer(face_attrib, 1, GL_UNSIGNED_INT, 0, (void*)0);
+    glVertexAttribDivisor(face_attrib, 1);
+    glEnableVertexAttribArray(face_attrib);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    return new_buffer;
+}
+
+void destroy_face_buffer(FaceBuffer* buffer)
+{
+    glDeleteBuffers(1, &buffer->face_buffer_id);
+    glDeleteVertexArrays(1, &buffer->vertex_array_id);
+    free(buffer->records);
+    free(buffer->slots);
+    free(buffer);
+}
+
+void face_buffer_build(FaceBuffer* buffer, const Chunk* chunk)
+{
+    unsigned long long exposed[DIR_COUNT];
+    unsigned long long faces;
+    int x_idx;
+    int y_idx;
+    int z_idx;
+    int word;
+    int dir;
+    int bit;
+
+    buffer->count = 0;
+    memset(buffer->slots, 0, FACES_PER_CHUNK * sizeof(unsigned short));
+
+    for (x_idx = 0; x_idx < CHUNK_SIZE && !(chunk->flags & CHUNK_ALL_AIR);
+         x_idx++)
+    {
+        for (word = 0; word < SOLID_WORDS; word++)
+        {
+            chunk_exposed_faces(chunk, x_idx, word, exposed);
+            for (dir = 0; dir < DIR_COUNT; dir++)
+            {
+                for (faces = exposed[dir]; faces != 0; faces &= faces - 1)
+                {
+                    bit = __builtin_ctzll(faces);
+                    y_idx = word * SOLID_ROWS_PER_WORD + bit / CHUNK_SIZE;
+                    z_idx = bit % CHUNK_SIZE;
+                    face_set(buffer, x_idx, y_idx, z_idx, dir,
+                             block_tile((chunk->ids)[x_idx][y_idx][z_idx]));
+                }
+            }
+        }
+    }
+
+    buffer->dirty_lo = 0;
+    buffer->dirty_hi = buffer->count;
+}
+
+void face_buffer_update_block(FaceBuffer* buffer, const Chunk* chunk,
+                              int dx, int dy, int dz)
+{
+    int dir;
+    int nx;
+    int ny;
+    int nz;
+
+    for (dir = 0; dir < DIR_COUNT; dir++)
+    {
+        face_refresh(buffer, chunk, dx, dy, dz, dir);
+
+        nx = dx + DIR_OFFSETS[dir][0];
+        ny = dy + DIR_OFFSETS[dir][1];
+        nz = dz + DIR_OFFSETS[dir][2];
+        if (nx >= 0 && nx < CHUNK_SIZE &&
+            ny >= 0 && ny < CHUNK_SIZE &&
+            nz >= 0 && nz < CHUNK_SIZE)
+        {
+            face_refresh(buffer, chunk, nx, ny, nz, opposite[dir]);
+        }
+    }
+}
+
+void face_buffer_upload(FaceBuffer* buffer)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->face_buffer_id);
+    if (buffer->capacity > buffer->gpu_capacity)
+    {
+        // outgrew the GL buffer, reallocate and send everything
+        glBufferData(GL_ARRAY_BUFFER, buffer->capacity * sizeof(GLuint),
+                     NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, buffer->count * sizeof(GLuint),
+                        buffer->records);
+        buffer->gpu_capacity = buffer->capacity;
+    }
+    else if (buffer->dirty_hi > buffer->dirty_lo)
+    {
+        if (buffer->dirty_hi > buffer->count)
+        {
+            buffer->dirty_hi = buffer->count;
+        }
+        if (buffer->dirty_hi > buffer->dirty_lo)
+        {
+            glBufferSubData(GL_ARRAY_BUFFER,
+                            buffer->dirty_lo * sizeof(GLuint),
+                            (buffer->dirty_hi - buffer->dirty_lo) *
+                                sizeof(GLuint),
+                            buffer->records + buffer->dirty_lo);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    buffer->dirty_lo = FACES_PER_CHUNK;
+    buffer->dirty_hi = 0;
+}
+
+void face_buffer_draw(FaceBuffer* buffer)
+{
+    if (buffer->count == 0)
+    {
+        return;
+    }
+    glBindVertexArray(buffer->vertex_array_id);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, buffer->count);
+    glBindVertexArray(0);
+}
@@ -0,0 +1,100 @@
+/*
+ * Instanced per-face rendering for chunks that change every frame.
+ *
+ * Instead of baking a mesh, a chunk on this path is drawn from a buffer of
+ * visible-face records, 4 bytes each:
+ *
+ *   bits  0-3:  x of block in chunk
+ *   bits  4-7:  y of block in chunk
+ *   bits  8-11: z of block in chunk
+ *   bits 12-14: direction the face points in (DIR_*)
+ *   bits 16-23: tile of the texture atlas
+ *
+ * A single static quad is drawn once per record with glDrawArraysInstanced,
+ * and the vertex shader (shaders/face_vertex_shader.glsl) expands it into
+ * the right face. Adding, changing or removing a face is a 4-byte write into
+ * the record buffer plus a ranged upload.
+ */
+
+#ifndef FACES_H
+#define FACES_H
+
+#include <GL/glew.h>
+
+#include "chunk.h"
+
+#define FACE_VERTEX_SHADER_PATH "shaders/face_vertex_shader.glsl"
+#define FACES_PER_CHUNK (BLOCKS_PER_CHUNK * DIR_COUNT)
+#define TEXTURE_ATLAS_PATH "./assets/textures/texture_atlas.png"
+#define ATLAS_TILES 16 // atlas is 16x16 tiles
+
+typedef struct FaceBufferTag
+{
+    GLuint vertex_array_id;
+    GLuint face_buffer_id;
+    GLuint* records; // packed face records, see above
+    int count; // number of live records
+    int capacity; // number of records allocated in @records
+    int gpu_capacity; // number of records allocated in the GL buffer
+    unsigned short* slots; // record index + 1 for each block face, 0 if none
+    int dirty_lo; // first record that changed since last upload
+    int dirty_hi; // one past the last record that changed
+} FaceBuffer;
+
+/*
+ * Create the static quad shared by all face buffers. Call once after the
+ * face shader program is loaded.
+ *
+ * @corner_attrib_idx: location of the 'corner' attribute (per vertex).
+ * @face_attrib_idx: location of the 'face' attribute (per instance).
+ */
+void faces_init(GLint corner_attrib_idx, GLint face_attrib_idx);
+
+/*
+ * Pack a face record.
+ *
+ * @dx, @dy, @dz: coordinate of the block in its chunk.
+ * @dir: DIR_* the face points in.
+ * @tile: tile of the texture atlas, row * ATLAS_TILES + column.
+ */
+GLuint face_pack(int dx, int dy, int dz, int dir, int tile);
+
+/*
+ * Get the atlas tile a block id is textured with.
+ */
+int block_tile(int id);
+
+/*
+ * Construct an empty face buffer.
+ */
+FaceBuffer* construct_face_buffer();
+
+/*
+ * Free a face buffer and its GL objects.
+ */
+void destroy_face_buffer(FaceBuffer* buffer);
+
+/*
+ * Rebuild all face records of a chunk. Only faces next to air are kept.
+ */
+void face_buffer_build(FaceBuffer* buffer, const Chunk* chunk);
+
+/*
+ * Patch the records touched by a change of the block at @dx, @dy, @dz: its
+ * own six faces and the facing faces of its six neighbours.
+ */
+void face_buffer_update_block(FaceBuffer* buffer, const Chunk* chunk,
+                              int dx, int dy, int dz);
+
+/*
+ * Upload the records that changed since the last upload.
+ */
+void face_buffer_upload(FaceBuffer* buffer);
+
+/*
+ * Draw a face buffer. The face program must be in use with its 'origin'
+ * uniform set to the chunk's corner.
+ */
+void face_buffer_draw(FaceBuffer* buffer);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ * Implementation of the quality governor.
+ */
+
+#include "governor.h"
+
+static GovernorState state;
+static int have_average = 0;
+static float slow_since = -1.0f; // when frames got too slow, -1 if not
+static float fast_since = -1.0f; // when frames got fast, -1 if not
+static float last_change = 0.0f;
+
+/*
+ * Lower one setting. Returns 0 if everything is at its minimum.
+ */
+static int degrade()
+{
+    int gpu_bound = state.gpu_ms > state.cpu_ms;
+
+    if (!gpu_bound && state.upload_budget > GOVERNOR_MIN_UPLOADS)
+    {
+        state.upload_budget /= 2;
+        if (state.upload_budget < GOVERNOR_MIN_UPLOADS)
+        {
+            state.upload_budget = GOVERNOR_MIN_UPLOADS;
+        }
+        snprintf(state.last, sizeof(state.last), "cpu bound: uploads %d",
+                 state.upload_budget);
+    }
+    else if (!gpu_bound && state.workers > 1)
+    {
+        state.workers--;
+        snprintf(state.last, sizeof(state.last), "cpu bound: workers %d",
+                 state.workers);
+    }
+    else if (state.radius > GOVERNOR_MIN_RADIUS)
+    {
+        state.radius--;
+        snprintf(state.last, sizeof(state.last), "%s bound: radius %d",
+                 gpu_bound ? "gpu" : "cpu", state.radius);
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Raise one setting, in reverse order of degrade(). Returns 0 if
+ * everything is at its maximum.
+ */
+static int improve()
+{
+    if (state.radius < state.max_radius)
+    {
+        state.radius++;
+        snprintf(state.last, sizeof(state.last), "headroom: radius %d",
+                 state.radius);
+    }
+    else if (state.workers < state.max_workers)
+    {
+        state.workers++;
+        snprintf(state.last, sizeof(state.last), "headroom: workers %d",
+                 state.workers);
+    }
+    else if (state.upload_budget < GOVERNOR_MAX_UPLOADS)
+    {
+        state.upload_budget *= 2;
+        if (state.upload_budget > GOVERNOR_MAX_UPLOADS)
+        {
+            state.upload_budget = GOVERNOR_MAX_UPLOADS;
+        }
+        snprintf(state.last, sizeof(state.last), "headroom: uploads %d",
+                 state.upload_budget);
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+void governor_init(float target_ms, int radius, int max_radius, int workers)
+{
+    state.target_ms = target_ms;
+    state.cpu_ms = 0.0f;
+    state.gpu_ms = 0.0f;
+    state.radius = radius;
+    state.max_radius = max_radius;
+    state.upload_budget = GOVERNOR_MAX_UPLOADS;
+    state.workers = workers;
+    state.max_workers = workers;
+    state.changes = 0;
+    snprintf(state.last, sizeof(state.last), "none");
+    have_average = 0;
+    slow_since = -1.0f;
+    fast_since = -1.0f;
+    last_change = 0.0f;
+}
+
+int governor_update(float cpu_ms, float gpu_ms, float now)
+{
+    float frame_ms;
+    int changed = 0;
+
+    if (!have_average)
+    {
+        state.cpu_ms = cpu_ms;
+        state.gpu_ms = gpu_ms;
+        have_average = 1;
+    }
+    state.cpu_ms += GOVERNOR_SMOOTHING * (cpu_ms - state.cpu_ms);
+    if (gpu_ms > 0.0f)
+    {
+        state.gpu_ms += GOVERNOR_SMOOTHING * (gpu_ms - state.gpu_ms);
+    }
+    frame_ms = (state.gpu_ms > state.cpu_ms) ? state.gpu_ms : state.cpu_ms;
+
+    // how long frames have been too slow or fast, in between resets both
+    if (frame_ms > state.target_ms * GOVERNOR_SLOW)
+    {
+        slow_since = (slow_since < 0.0f) ? now : slow_since;
+        fast_since = -1.0f;
+    }
+    else if (frame_ms < state.target_ms * GOVERNOR_FAST)
+    {
+        fast_since = (fast_since < 0.0f) ? now : fast_since;
+        slow_since = -1.0f;
+    }
+    else
+    {
+        slow_since = -1.0f;
+        fast_since = -1.0f;
+    }
+
+    if (now - last_change < GOVERNOR_SETTLE)
+    {
+        return 0;
+    }
+    if (slow_since >= 0.0f && now - slow_since >= GOVERNOR_HOLD)
+    {
+        changed = degrade();
+    }
+    else if (fast_since >= 0.0f && now - fast_since >= GOVERNOR_HOLD)
+    {
+        changed = improve();
+    }
+    if (changed)
+    {
+        state.changes++;
+        last_change = now;
+        slow_since = -1.0f;
+        fast_since = -1.0f;
+    }
+    return changed;
+}
+
+const GovernorState* governor_state()
+{
+    return &state;
+}
+
+void governor_print(FILE* file)
+{
+    fprintf(file, "governor: cpu %.1f ms, gpu %.1f ms (target %.1f), "
+            "radius %d, uploads %d, workers %d, %d changes, last: %s\n",
+            state.cpu_ms, state.gpu_ms, state.target_ms, state.radius,
+            state.upload_budget, state.workers, state.changes, state.last);
+}
@@ -0,0 +1,81 @@
+/*
+ * Quality governor: trades detail for frame time to hold a target frame
+ * time.
+ *
+ * The governor keeps smoothed CPU and GPU times per frame. When frames
+ * stay too slow it lowers one setting, picked by what limits the frame: a
+ * GPU-bound frame gets a smaller view radius; a CPU-bound frame first gets
+ * fewer mesh uploads per frame, then fewer workers competing with the main
+ * thread, then a smaller view radius. When frames stay fast it gives the
+ * settings back in reverse order: view radius, then workers, then mesh
+ * uploads.
+ *
+ * To keep the settings from flipping back and forth, the thresholds for
+ * too slow and fast enough are well apart, a state has to last
+ * GOVERNOR_HOLD seconds before the governor acts, and every change is
+ * given GOVERNOR_SETTLE seconds to show before the next.
+ *
+ * Everything here runs on the main thread.
+ */
+
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <stdio.h>
+
+#define GOVERNOR_TARGET_MS 16.6f // 60 frames per second
+#define GOVERNOR_SMOOTHING 0.05f // weight of the newest frame in the average
+#define GOVERNOR_SLOW 1.1f // frames over target * this are too slow
+#define GOVERNOR_FAST 0.7f // frames under target * this leave headroom
+#define GOVERNOR_HOLD 1.0f // seconds too slow/fast before acting
+#define GOVERNOR_SETTLE 2.0f // seconds after a change before the next
+#define GOVERNOR_MIN_RADIUS 1
+#define GOVERNOR_MIN_UPLOADS 2
+#define GOVERNOR_MAX_UPLOADS 64
+
+typedef struct GovernorStateTag
+{
+    float target_ms; // frame time to hold
+    float cpu_ms; // smoothed CPU time per frame
+    float gpu_ms; // smoothed GPU time per frame, 0 if not measured
+    int radius; // view radius in chunks
+    int max_radius;
+    int upload_budget; // meshes uploaded per frame at most
+    int workers; // worker threads allowed to run jobs
+    int max_workers;
+    int changes; // since start
+    char last[64]; // last decision, for logging
+} GovernorState;
+
+/*
+ * Set up the governor with every setting at the given maximum except the
+ * view radius.
+ *
+ * @target_ms: frame time to hold.
+ * @radius: starting view radius in chunks.
+ * @max_radius: largest view radius in chunks.
+ * @workers: number of worker threads.
+ */
+void governor_init(float target_ms, int radius, int max_radius, int workers);
+
+/*
+ * Account for a finished frame and adjust the settings. Returns 1 if a
+ * setting changed.
+ *
+ * @cpu_ms: main thread time of the frame.
+ * @gpu_ms: GPU time of a recent frame, 0 if not known.
+ * @now: clock in seconds.
+ */
+int governor_update(float cpu_ms, float gpu_ms, float now);
+
+/*
+ * Get the current settings and averages.
+ */
+const GovernorState* governor_state();
+
+/*
+ * Print the current settings and averages on one line.
+ */
+void governor_print(FILE* file);
+
+#endif
@@ -0,0 +1,625 @@
+/*
+ * Implementation of the importer.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "importer.h"
+#include "chunk.h"
+#include "column.h"
+#include "jobs.h"
+#include "storage.h"
+#include "terrain.h"
+#include "world.h"
+#include "../deps/lodepng/lodepng.h"
+
+#define PATH_SIZE 256
+#define OPEN_FILES 4 // hunk files a job keeps open
+#define TERRAIN_TOP (TERRAIN_BASE + (int)TERRAIN_MAX_AMPLITUDE)
+#define NO_PIXEL (-0x7fffffff) // top of a column outside the heightmap
+#define VOX_MAGIC "VOX "
+#define VOX_CHUNK_HEADER 12 // id, content size, children size
+
+/*
+ * The hunk files a job has open. A job only ever writes its own slots, so
+ * jobs may open the same file at once.
+ */
+typedef struct HunkFilesTag
+{
+    int h[OPEN_FILES][3];
+    int fd[OPEN_FILES];
+    int count;
+    int next_victim;
+} HunkFiles;
+
+typedef struct HeightmapTag
+{
+    unsigned char* image; // 1 byte per pixel, rows along x
+    unsigned int width;
+    unsigned int height;
+    int at[3];
+    long written; // chunks written, shared by all jobs
+} Heightmap;
+
+/*
+ * The part of a heightmap in one hunk column.
+ */
+typedef struct HeightTileTag
+{
+    Heightmap* map;
+    int h[2]; // hunk x, z
+} HeightTile;
+
+/*
+ * The voxels of a .vox file that fall in one chunk.
+ */
+typedef struct VoxTileTag
+{
+    int (*voxels)[3]; // block positions
+    int count;
+    long* written;
+} VoxTile;
+
+static void init_files(HunkFiles* files)
+{
+    files->count = 0;
+    files->next_victim = 0;
+}
+
+static void close_files(HunkFiles* files)
+{
+    int idx;
+
+    for (idx = 0; idx < files->count; idx++)
+    {
+        if (files->fd[idx] >= 0)
+        {
+            close(files->fd[idx]);
+        }
+    }
+    files->count = 0;
+}
+
+/*
+ * Get the file of the hunk that chunk @c is in, opening or creating it if
+ * needed. Returns -1 if it can't be opened.
+ */
+static int hunk_file(HunkFiles* files, const int* c)
+{
+    char path[PATH_SIZE];
+    int h[3];
+    int idx;
+
+    h[0] = hunk_coord(c[0]);
+    h[1] = hunk_coord(c[1]);
+    h[2] = hunk_coord(c[2]);
+    for (idx = 0; idx < files->count; idx++)
+    {
+        if (files->h[idx][0] == h[0] && files->h[idx][1] == h[1] &&
+            files->h[idx][2] == h[2])
+        {
+            return files->fd[idx];
+        }
+    }
+
+    if (files->count < OPEN_FILES)
+    {
+        idx = files->count++;
+    }
+    else
+    {
+        idx = files->next_victim;
+        files->next_victim = (files->next_victim + 1) % OPEN_FILES;
+        if (files->fd[idx] >= 0)
+        {
+            close(files->fd[idx]);
+        }
+    }
+    memcpy(files->h[idx], h, sizeof(h));
+    hunk_path(path, PATH_SIZE, storage_dir(), h[0], h[1], h[2]);
+    files->fd[idx] = open(path, O_RDWR | O_CREAT, 0644);
+    if (files->fd[idx] < 0)
+    {
+        fprintf(stderr, "open %s failed: %d\n", path, errno);
+    }
+    return files->fd[idx];
+}
+
+/*
+ * Fill a chunk with what is there before the import: its saved blocks if
+ * it was saved, generated terrain otherwise.
+ */
+static void load_base(HunkFiles* files, Chunk* chunk, const int* c)
+{
+    unsigned char slot[SLOT_SIZE];
+    int fd;
+
+    fd = hunk_file(files, c);
+    if (fd >= 0 &&
+        pread(fd, slot, SLOT_SIZE, slot_offset(c[0], c[1], c[2])) ==
+            SLOT_SIZE &&
+        memcmp(slot, SLOT_MAGIC, 4) == 0)
+    {
+        memcpy(chunk->ids, slot + SLOT_HEADER_SIZE, BLOCKS_PER_CHUNK);
+        return;
+    }
+
+    memset(chunk->ids, BLOCK_AIR, BLOCKS_PER_CHUNK);
+    generate_terrain(chunk);
+    if (chunk->column)
+    {
+        column_release(chunk->column);
+        chunk->column = NULL;
+    }
+}
+
+/*
+ * Write a chunk into its slot. Returns 1 if it was written.
+ */
+static int write_chunk(HunkFiles* files, const Chunk* chunk, const int* c)
+{
+    unsigned char slot[SLOT_SIZE];
+    int fd;
+
+    fd = hunk_file(files, c);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    pack_slot(chunk, slot);
+    if (pwrite(fd, slot, SLOT_SIZE, slot_offset(c[0], c[1], c[2])) !=
+        SLOT_SIZE)
+    {
+        fprintf(stderr, "Writing chunk %d %d %d failed: %d\n", c[0], c[1],
+                c[2], errno);
+        return 0;
+    }
+    return 1;
+}
+
+static void place_chunk(Chunk* chunk, const int* c)
+{
+    chunk->a[0] = c[0] * CHUNK_SIZE;
+    chunk->a[1] = c[1] * CHUNK_SIZE;
+    chunk->a[2] = c[2] * CHUNK_SIZE;
+}
+
+/*
+ * Get the top block of pixel @px, @pz, NO_PIXEL if it is outside the
+ * image.
+ */
+static int pixel_top(const Heightmap* map, int px, int pz)
+{
+    if (px < 0 || pz < 0 || px >= (int)map->width || pz >= (int)map->height)
+    {
+        return NO_PIXEL;
+    }
+    return map->at[1] +
+           map->image[(long)pz * map->width + px] / IMPORT_LEVELS_PER_BLOCK;
+}
+
+/*
+ * Write the chunks of one chunk column of a heightmap.
+ */
+static long import_column(const Heightmap* map, HunkFiles* files,
+                          Chunk* chunk, int cx, int cz)
+{
+    int tops[CHUNK_SIZE][CHUNK_SIZE];
+    int c[3];
+    int highest = NO_PIXEL;
+    int covered = 0;
+    int top;
+    int dx;
+    int dy;
+    int dz;
+    long written = 0;
+
+    for (dx = 0; dx < CHUNK_SIZE; dx++)
+    {
+        for (dz = 0; dz < CHUNK_SIZE; dz++)
+        {
+            tops[dx][dz] = pixel_top(map, cx * CHUNK_SIZE + dx - map->at[0],
+                                     cz * CHUNK_SIZE + dz - map->at[2]);
+            if (tops[dx][dz] != NO_PIXEL)
+            {
+                covered++;
+                if (tops[dx][dz] > highest)
+                {
+                    highest = tops[dx][dz];
+                }
+            }
+        }
+    }
+    if (covered == 0)
+    {
+        return 0;
+    }
+    if (highest < TERRAIN_TOP)
+    {
+        highest = TERRAIN_TOP; // keep terrain out of the import
+    }
+
+    c[0] = cx;
+    c[2] = cz;
+    for (c[1] = chunk_coord(map->at[1]); c[1] <= chunk_coord(highest); c[1]++)
+    {
+        place_chunk(chunk, c);
+        if (covered < CHUNK_SIZE * CHUNK_SIZE)
+        {
+            load_base(files, chunk, c);
+        }
+        for (dx = 0; dx < CHUNK_SIZE; dx++)
+        {
+            for (dz = 0; dz < CHUNK_SIZE; dz++)
+            {
+                if (tops[dx][dz] == NO_PIXEL)
+                {
+                    continue;
+                }
+                top = tops[dx][dz] - chunk->a[1];
+                for (dy = 0; dy < CHUNK_SIZE; dy++)
+                {
+                    (chunk->ids)[dx][dy][dz] =
+                        (dy <= top) ? BLOCK_DIRT : BLOCK_AIR;
+                }
+            }
+        }
+        written += write_chunk(files, chunk, c);
+    }
+    return written;
+}
+
+static void heightmap_job(void* arg, int canceled)
+{
+    HeightTile* tile = arg;
+    HunkFiles files;
+    Chunk* chunk;
+    long written = 0;
+    int cx;
+    int cz;
+
+    if (canceled)
+    {
+        return;
+    }
+    init_files(&files);
+    chunk = construct_chunk(0, 0, 0);
+    for (cx = tile->h[0] * HUNK_SIZE; cx < (tile->h[0] + 1) * HUNK_SIZE; cx++)
+    {
+        for (cz = tile->h[1] * HUNK_SIZE; cz < (tile->h[1] + 1) * HUNK_SIZE;
+             cz++)
+        {
+            written += import_column(tile->map, &files, chunk, cx, cz);
+        }
+    }
+    destroy_chunk(chunk);
+    close_files(&files);
+    __atomic_add_fetch(&tile->map->written, written, __ATOMIC_RELAXED);
+}
+
+long import_heightmap(const char* path, const int* at)
+{
+    Heightmap map;
+    HeightTile* tiles;
+    Job** jobs;
+    unsigned int error;
+    int h_min[2];
+    int h_max[2];
+    int count;
+    int idx;
+    int hx;
+    int hz;
+
+    error = lodepng_decode_file(&map.image, &map.width, &map.height, path,
+                                LCT_GREY, 8);
+    if (error)
+    {
+        fprintf(stderr, "Could not load heightmap '%s', error %u: %s\n",
+                path, error, lodepng_error_text(error));
+        return -1;
+    }
+    memcpy(map.at, at, sizeof(map.at));
+    map.written = 0;
+
+    // one job per hunk column
+    h_min[0] = hunk_coord(chunk_coord(at[0]));
+    h_min[1] = hunk_coord(chunk_coord(at[2]));
+    h_max[0] = hunk_coord(chunk_coord(at[0] + (int)map.width - 1));
+    h_max[1] = hunk_coord(chunk_coord(at[2] + (int)map.height - 1));
+    count = (h_max[0] - h_min[0] + 1) * (h_max[1] - h_min[1] + 1);
+    tiles = malloc(count * sizeof(HeightTile));
+    jobs = malloc(count * sizeof(Job*));
+    idx = 0;
+    for (hx = h_min[0]; hx <= h_max[0]; hx++)
+    {
+        for (hz = h_min[1]; hz <= h_max[1]; hz++)
+        {
+            tiles[idx].map = &map;
+            tiles[idx].h[0] = hx;
+            tiles[idx].h[1] = hz;
+            jobs[idx] = job_create(heightmap_job, &tiles[idx],
+                                   JOB_PRIORITY_NORMAL);
+            job_submit(jobs[idx]);
+            idx++;
+        }
+    }
+    for (idx = 0; idx < count; idx++)
+    {
+        job_wait(jobs[idx]);
+        job_release(jobs[idx]);
+    }
+
+    free(jobs);
+    free(tiles);
+    free(map.image);
+    return map.written;
+}
+
+static unsigned int read_u32(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+/*
+ * Read a whole file. Returns NULL if it can't be read.
+ */
+static unsigned char* read_file(const char* path, long* size)
+{
+    unsigned char* data;
+    FILE* file;
+
+    file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data = malloc(*size > 0 ? *size : 1);
+    if (*size < 0 || fread(data, 1, *size, file) != (size_t)*size)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+/*
+ * Collect the voxels of every model of a .vox file at their block
+ * positions. Returns the number of voxels, -1 if the file is malformed.
+ */
+static long parse_vox(const unsigned char* data, long size, const int* at,
+                      int (**voxels)[3])
+{
+    const unsigned char* p;
+    const unsigned char* end = data + size;
+    const unsigned char* xyzi;
+    unsigned int content;
+    unsigned int children;
+    unsigned int count;
+    unsigned int idx;
+    long total = 0;
+    long capacity = 0;
+    int model_size[3] = {0, 0, 0};
+    int offset = 0; // x of the current model
+
+    *voxels = NULL;
+    if (size < 8 + VOX_CHUNK_HEADER || memcmp(data, VOX_MAGIC, 4) != 0 ||
+        memcmp(data + 8, "MAIN", 4) != 0 ||
+        read_u32(data + 12) > (unsigned long)(size - 8 - VOX_CHUNK_HEADER))
+    {
+        return -1;
+    }
+
+    // the models are children of MAIN, SIZE then XYZI
+    for (p = data + 8 + VOX_CHUNK_HEADER + read_u32(data + 12);
+         p + VOX_CHUNK_HEADER <= end;
+         p += VOX_CHUNK_HEADER + content + children)
+    {
+        content = read_u32(p + 4);
+        children = read_u32(p + 8);
+        if (content > (unsigned long)(end - p - VOX_CHUNK_HEADER) ||
+            children > (unsigned long)(end - p - VOX_CHUNK_HEADER) - content)
+        {
+            free(*voxels);
+            *voxels = NULL;
+            return -1;
+        }
+        if (memcmp(p, "SIZE", 4) == 0 && content >= 12)
+        {
+            offset += model_size[0];
+            model_size[0] = (int)read_u32(p + VOX_CHUNK_HEADER);
+            model_size[1] = (int)read_u32(p + VOX_CHUNK_HEADER + 4);
+            model_size[2] = (int)read_u32(p + VOX_CHUNK_HEADER + 8);
+        }
+        else if (memcmp(p, "XYZI", 4) == 0 && content >= 4)
+        {
+            count = read_u32(p + VOX_CHUNK_HEADER);
+            if (count > (content - 4) / 4)
+            {
+                free(*voxels);
+                return -1;
+            }
+            if (total + count > capacity)
+            {
+                capacity = (total + count) * 2;
+                *voxels = realloc(*voxels, capacity * sizeof(**voxels));
+            }
+            xyzi = p + VOX_CHUNK_HEADER + 4;
+            for (idx = 0; idx < count; idx++, xyzi += 4)
+            {
+                // .vox is z up
+                (*voxels)[total][0] = at[0] + offset + xyzi[0];
+                (*voxels)[total][1] = at[1] + xyzi[2];
+                (*voxels)[total][2] = at[2] + xyzi[1];
+                total++;
+            }
+        }
+    }
+    return total;
+}
+
+/*
+ * Order voxels by chunk.
+ */
+static int compare_voxels(const void* a, const void* b)
+{
+    const int* p = a;
+    const int* q = b;
+    int axis;
+    int cp;
+    int cq;
+
+    for (axis = 0; axis < 3; axis++)
+    {
+        cp = chunk_coord(p[axis]);
+        cq = chunk_coord(q[axis]);
+        if (cp != cq)
+        {
+            return (cp < cq) ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+static void vox_job(void* arg, int canceled)
+{
+    VoxTile* tile = arg;
+    HunkFiles files;
+    Chunk* chunk;
+    int c[3];
+    int idx;
+    int* p;
+
+    if (canceled)
+    {
+        return;
+    }
+    init_files(&files);
+    c[0] = chunk_coord(tile->voxels[0][0]);
+    c[1] = chunk_coord(tile->voxels[0][1]);
+    c[2] = chunk_coord(tile->voxels[0][2]);
+    chunk = construct_chunk(0, 0, 0);
+    place_chunk(chunk, c);
+    load_base(&files, chunk, c);
+    for (idx = 0; idx < tile->count; idx++)
+    {
+        p = tile->voxels[idx];
+        (chunk->ids)[p[0] - chunk->a[0]][p[1] - chunk->a[1]]
+                    [p[2] - chunk->a[2]] = BLOCK_DIRT;
+    }
+    __atomic_add_fetch(tile->written, write_chunk(&files, chunk, c),
+                       __ATOMIC_RELAXED);
+    destroy_chunk(chunk);
+    close_files(&files);
+}
+
+long import_vox(const char* path, const int* at)
+{
+    unsigned char* data;
+    int (*voxels)[3];
+    VoxTile* tiles;
+    Job** jobs;
+    long size;
+    long total;
+    long written = 0;
+    long start;
+    long idx;
+    int count = 0;
+
+    data = read_file(path, &size);
+    if (data == NULL)
+    {
+        fprintf(stderr, "Could not read '%s'.\n", path);
+        return -1;
+    }
+    total = parse_vox(data, size, at, &voxels);
+    free(data);
+    if (total < 0)
+    {
+        fprintf(stderr, "'%s' is not a MagicaVoxel file.\n", path);
+        return -1;
+    }
+    qsort(voxels, total, sizeof(*voxels), compare_voxels);
+
+    // one job per chunk
+    tiles = malloc((total > 0 ? total : 1) * sizeof(VoxTile));
+    for (start = 0; start < total; start = idx)
+    {
+        for (idx = start + 1;
+             idx < total && compare_voxels(voxels[start], voxels[idx]) == 0;
+             idx++)
+        {
+        }
+        tiles[count].voxels = &voxels[start];
+        tiles[count].count = (int)(idx - start);
+        tiles[count].written = &written;
+        count++;
+    }
+    jobs = malloc((count > 0 ? count : 1) * sizeof(Job*));
+    for (idx = 0; idx < count; idx++)
+    {
+        jobs[idx] = job_create(vox_job, &tiles[idx], JOB_PRIORITY_NORMAL);
+        job_submit(jobs[idx]);
+    }
+    for (idx = 0; idx < count; idx++)
+    {
+        job_wait(jobs[idx]);
+        job_release(jobs[idx]);
+    }
+
+    free(jobs);
+    free(tiles);
+    free(voxels);
+    return written;
+}
+
+int import_run(const char* path, const int* at)
+{
+    struct timespec start;
+    struct timespec end;
+    const char* extension;
+    long written;
+
+    jobs_init(0);
+    if (storage_init(WORLD_DIR) != 0)
+    {
+        fprintf(stderr, "Could not set up world storage.\n");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    extension = strrchr(path, '.');
+    if (extension && strcmp(extension, ".vox") == 0)
+    {
+        written = import_vox(path, at);
+    }
+    else if (extension && strcmp(extension, ".png") == 0)
+    {
+        written = import_heightmap(path, at);
+    }
+    else
+    {
+        fprintf(stderr, "Can only import .png heightmaps and .vox models.\n");
+        written = -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    jobs_shutdown();
+    storage_shutdown();
+    if (written < 0)
+    {
+        return 1;
+    }
+    printf("Imported %ld chunks from %s in %.2f s.\n", written, path,
+           (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9);
+    return 0;
+}
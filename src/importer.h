@@ -0,0 +1,53 @@
+/*
+ * Offline import of external data into world storage (see storage.h).
+ *
+ * Two inputs are understood:
+ *   - Heightmap PNGs (decoded by lodepng). Each pixel is one block column,
+ *     IMPORT_LEVELS_PER_BLOCK grey levels per block of height. Pixel (0, 0)
+ *     lands on @at, x to the west, y to the north.
+ *   - MagicaVoxel .vox models. Every SIZE/XYZI model of the file is placed
+ *     next to the previous one along x, with the model's z as up. Voxels of
+ *     any colour become dirt, the only solid block there is.
+ *
+ * The input is split into tiles that are converted on all cores with the
+ * job system. Each job fills one chunk at a time and writes its slot
+ * straight into the hunk file, so the output never sits in memory.
+ * Heightmap tiles are whole hunk columns, so jobs never share a file.
+ * Chunks the input only partly covers keep what was saved or generated
+ * there before. Chunks above the input are written as air up to the top
+ * of the generated terrain, so the terrain does not grow back into the
+ * import.
+ *
+ * The hunk files are written directly, not through asyncio.h. Do not
+ * import into a world that is being played or served.
+ */
+
+#ifndef IMPORTER_H
+#define IMPORTER_H
+
+#define IMPORT_LEVELS_PER_BLOCK 4 // 256 grey levels -> 64 blocks of height
+
+/*
+ * Import a heightmap PNG. Returns the number of chunks written, -1 on
+ * error. Jobs and storage must be set up.
+ *
+ * @at: block position of pixel (0, 0) at grey level 0.
+ */
+long import_heightmap(const char* path, const int* at);
+
+/*
+ * Import the models of a MagicaVoxel .vox file. Returns the number of
+ * chunks written, -1 on error. Jobs and storage must be set up.
+ *
+ * @at: block position of voxel (0, 0, 0) of the first model.
+ */
+long import_vox(const char* path, const int* at);
+
+/*
+ * Run the importer as the whole program: import @path (a .png or .vox
+ * file) into WORLD_DIR and report how long it took. Returns the exit
+ * status.
+ */
+int import_run(const char* path, const int* at);
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * Implementation of mouse input, frame pacing and latency measurement.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+
+#include "input.h"
+
+static double last_x;
+static double last_y;
+static int have_last = 0;
+static float motion[2]; // summed since the last take
+static double motion_since = -1.0; // time of the oldest untaken event
+static double latched_since = -1.0; // same, for the motion of this frame
+static double last_swap = 0.0;
+static int pacing = 0;
+static int measuring = 0;
+static int depth_prepass = 0;
+static int overdraw = 0;
+static double latency_sum = 0.0;
+static double latency_max = 0.0;
+static int latency_count = 0;
+
+static void on_cursor(GLFWwindow* window, double x, double y)
+{
+    (void)window;
+    if (have_last)
+    {
+        motion[0] += (float)(x - last_x);
+        motion[1] += (float)(y - last_y);
+        if (motion_since < 0.0)
+        {
+            motion_since = glfwGetTime();
+        }
+    }
+    last_x = x;
+    last_y = y;
+    have_last = 1;
+}
+
+static void on_key(GLFWwindow* window, int key, int scancode, int action,
+                   int mods)
+{
+    (void)window;
+    (void)scancode;
+    (void)mods;
+    if (action != GLFW_PRESS)
+    {
+        return;
+    }
+    if (key == PACING_KEY)
+    {
+        pacing = !pacing;
+        printf("Frame pacing %s.\n", pacing ? "on" : "off");
+    }
+    else if (key == LATENCY_KEY)
+    {
+        measuring = !measuring;
+        latency_sum = 0.0;
+        latency_max = 0.0;
+        latency_count = 0;
+        printf("Latency measurement %s.\n", measuring ? "on" : "off");
+    }
+    else if (key == PREPASS_KEY)
+    {
+        depth_prepass = !depth_prepass;
+        printf("Depth pre-pass %s.\n", depth_prepass ? "on" : "off");
+    }
+    else if (key == OVERDRAW_KEY)
+    {
+        overdraw = !overdraw;
+        printf("Overdraw view %s.\n", overdraw ? "on" : "off");
+    }
+}
+
+void input_init(GLFWwindow* window)
+{
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (glfwRawMouseMotionSupported())
+    {
+        glfwSetInputMode(window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
+    }
+    glfwSetCursorPosCallback(window, on_cursor);
+    glfwSetKeyCallback(window, on_key);
+    last_swap = glfwGetTime();
+}
+
+void input_take_motion(float* dx, float* dy)
+{
+    *dx = motion[0];
+    *dy = motion[1];
+    motion[0] = 0.0f;
+    motion[1] = 0.0f;
+    latched_since = motion_since;
+    motion_since = -1.0;
+}
+
+void input_pace(double period, double work)
+{
+    struct timespec pause;
+    double wait;
+
+    if (!pacing)
+    {
+        return;
+    }
+    wait = last_swap + period - work - PACING_MARGIN - glfwGetTime();
+    if (wait <= 0.0 || wait >= period)
+    {
+        return; // late already, or the clock jumped
+    }
+    pause.tv_sec = 0;
+    pause.tv_nsec = (long)(wait * 1e9);
+    nanosleep(&pause, NULL);
+}
+
+void input_swapped()
+{
+    double latency;
+
+    last_swap = glfwGetTime();
+    if (measuring && latched_since >= 0.0)
+    {
+        latency = last_swap - latched_since;
+        latency_sum += latency;
+        latency_count++;
+        if (latency > latency_max)
+        {
+            latency_max = latency;
+        }
+    }
+    latched_since = -1.0;
+}
+
+void input_print_latency(FILE* file)
+{
+    if (!measuring)
+    {
+        return;
+    }
+    if (latency_count > 0)
+    {
+        fprintf(file, "latency: input to swap %.2f ms avg, %.2f ms max "
+                "over %d frames\n", latency_sum / latency_count * 1000.0,
+                latency_max * 1000.0, latency_count);
+    }
+    latency_sum = 0.0;
+    latency_max = 0.0;
+    latency_count = 0;
+}
+
+int input_depth_prepass()
+{
+    return depth_prepass;
+}
+
+int input_overdraw()
+{
+    return overdraw;
+}
@@ -0,0 +1,74 @@
+/*
+ * Mouse input, frame pacing and latency measurement.
+ *
+ * The cursor is captured (disabled cursor mode, raw motion where the
+ * platform has it) and its motion is summed up by a callback as events
+ * arrive, so reading it never waits on the window system. The frame loop
+ * takes the summed motion as late as possible, right before drawing (the
+ * late latch).
+ *
+ * Frame pacing (toggled with PACING_KEY) sleeps at the start of a frame
+ * until just enough time is left to finish it by the next swap, so input
+ * is read later and shows sooner. Latency mode (toggled with LATENCY_KEY)
+ * measures the time from a mouse event to the swap that shows it.
+ *
+ * The key callback also keeps the draw loop's debug toggles: the depth
+ * pre-pass (PREPASS_KEY) and the overdraw view (OVERDRAW_KEY).
+ *
+ * Everything here runs on the main thread.
+ */
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdio.h>
+
+#include <GLFW/glfw3.h>
+
+#define PACING_KEY GLFW_KEY_F2
+#define LATENCY_KEY GLFW_KEY_F3
+#define PREPASS_KEY GLFW_KEY_F4
+#define OVERDRAW_KEY GLFW_KEY_F5
+#define PACING_MARGIN 0.002 // seconds of slack left before the swap
+
+/*
+ * Capture the cursor of @window and start listening to it.
+ */
+void input_init(GLFWwindow* window);
+
+/*
+ * Take the mouse motion (in counts) since the last call.
+ */
+void input_take_motion(float* dx, float* dy);
+
+/*
+ * Sleep until the frame has to start, if pacing is on. Call before polling
+ * events.
+ *
+ * @period: seconds between swaps.
+ * @work: seconds a frame takes to prepare.
+ */
+void input_pace(double period, double work);
+
+/*
+ * Note that the frame was swapped. Call right after glfwSwapBuffers().
+ */
+void input_swapped();
+
+/*
+ * Print the input-to-swap latency since the last call, if latency mode is
+ * on.
+ */
+void input_print_latency(FILE* file);
+
+/*
+ * Check if the depth pre-pass is toggled on.
+ */
+int input_depth_prepass();
+
+/*
+ * Check if the overdraw view is toggled on.
+ */
+int input_overdraw();
+
+#endif
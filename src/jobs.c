@@ -0,0 +1,484 @@
+/*
+ * Implementation of the work-stealing job system.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "jobs.h"
+
+#define MIN_DEQUE_SIZE 64
+
+// job states
+#define JOB_WAITING 0 // not submitted or waiting on dependencies
+#define JOB_QUEUED 1
+#define JOB_RUNNING 2
+#define JOB_FINISHED 3
+
+struct JobTag
+{
+    JobFunc func;
+    void* arg;
+    JobCheck check;
+    int priority;
+    int state; // JOB_*, guarded by @lock
+    int canceled; // guarded by @lock
+    int unfinished; // unfinished dependencies, +1 until submitted
+    int refs;
+    Job** dependents; // jobs waiting on this one, guarded by @lock
+    int dependent_count;
+    int dependent_capacity;
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+};
+
+/*
+ * Ring buffer of jobs. The owner pushes and pops at the tail, thieves take
+ * from the head.
+ */
+typedef struct DequeTag
+{
+    Job** jobs;
+    int head;
+    int count;
+    int capacity;
+} Deque;
+
+typedef struct WorkerTag
+{
+    pthread_t thread;
+    pthread_mutex_t lock; // guards @deques
+    Deque deques[JOB_PRIORITIES];
+    int index;
+} Worker;
+
+static Worker workers[MAX_WORKERS];
+static int worker_count = 0;
+static int next_worker = 0; // round robin for jobs queued by non-workers
+static int queued = 0; // jobs sitting in any deque
+static int stopping = 0; // guarded by sleep_lock
+static int active_count = 0; // workers allowed to run jobs
+static pthread_mutex_t sleep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t unpark = PTHREAD_COND_INITIALIZER; // for idle workers
+static __thread int self = -1; // index of the calling worker, -1 if none
+
+static void deque_push(Deque* deque, Job* job)
+{
+    Job** grown;
+    int idx;
+
+    if (deque->count == deque->capacity)
+    {
+        grown = malloc(2 * deque->capacity * sizeof(Job*));
+        for (idx = 0; idx < deque->count; idx++)
+        {
+            grown[idx] = deque->jobs[(deque->head + idx) % deque->capacity];
+        }
+        free(deque->jobs);
+        deque->jobs = grown;
+        deque->head = 0;
+        deque->capacity *= 2;
+    }
+    deque->jobs[(deque->head + deque->count) % deque->capacity] = job;
+    deque->count++;
+}
+
+static Job* deque_pop_tail(Deque* deque)
+{
+    if (deque->count == 0)
+    {
+        return NULL;
+    }
+    deque->count--;
+    return deque->jobs[(deque->head + deque->count) % deque->capacity];
+}
+
+static Job* deque_pop_head(Deque* deque)
+{
+    Job* job;
+
+    if (deque->count == 0)
+    {
+        return NULL;
+    }
+    job = deque->jobs[deque->head];
+    deque->head = (deque->head + 1) % deque->capacity;
+    deque->count--;
+    return job;
+}
+
+/*
+ * Put a job whose dependencies are all finished into a deque.
+ */
+static void enqueue(Job* job)
+{
+    Worker* worker;
+
+    if (self >= 0)
+    {
+        worker = &workers[self];
+    }
+    else
+    {
+        worker = &workers[__atomic_fetch_add(&next_worker, 1, __ATOMIC_RELAXED)
+                          % worker_count];
+    }
+
+    pthread_mutex_lock(&job->lock);
+    job->state = JOB_QUEUED;
+    pthread_mutex_unlock(&job->lock);
+
+    pthread_mutex_lock(&worker->lock);
+    deque_push(&worker->deques[job->priority], job);
+    pthread_mutex_unlock(&worker->lock);
+
+    __atomic_add_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&sleep_lock);
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&sleep_lock);
+}
+
+/*
+ * Take the most urgent job available to worker @index (-1 for a thread that
+ * is not a worker): own newest job first, then other workers' oldest.
+ */
+static Job* take_job(int index)
+{
+    Worker* worker;
+    Job* job;
+    int priority;
+    int offset;
+
+    for (priority = 0; priority < JOB_PRIORITIES; priority++)
+    {
+        for (offset = 0; offset < worker_count; offset++)
+        {
+            worker = &workers[((index < 0 ? 0 : index) + offset) % worker_count];
+            pthread_mutex_lock(&worker->lock);
+            if (worker->index == index)
+            {
+                job = deque_pop_tail(&worker->deques[priority]);
+            }
+            else
+            {
+                job = deque_pop_head(&worker->deques[priority]);
+            }
+            pthread_mutex_unlock(&worker->lock);
+            if (job)
+            {
+                __atomic_sub_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+                return job;
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Count down one unfinished dependency of @job, queueing it at zero.
+ */
+static void dependency_done(Job* job)
+{
+    if (__atomic_sub_fetch(&job->unfinished, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        enqueue(job);
+    }
+}
+
+static void run(Job* job)
+{
+    Job** dependents;
+    int dependent_count;
+    int canceled;
+    int idx;
+
+    pthread_mutex_lock(&job->lock);
+    canceled = job->canceled;
+    job->state = JOB_RUNNING;
+    pthread_mutex_unlock(&job->lock);
+
+    if (!canceled && job->check && !job->check(job->arg))
+    {
+        canceled = 1;
+    }
+    job->func(job->arg, canceled);
+
+    pthread_mutex_lock(&job->lock);
+    job->canceled = canceled;
+    job->state = JOB_FINISHED;
+    dependents = job->dependents;
+    dependent_count = job->dependent_count;
+    job->dependents = NULL;
+    job->dependent_count = 0;
+    pthread_cond_broadcast(&job->finished);
+    pthread_mutex_unlock(&job->lock);
+
+    for (idx = 0; idx < dependent_count; idx++)
+    {
+        if (canceled)
+        {
+            job_cancel(dependents[idx]);
+        }
+        dependency_done(dependents[idx]);
+        job_release(dependents[idx]); // reference held by the list
+    }
+    free(dependents);
+    job_release(job); // reference held by the scheduler
+}
+
+static void* worker_main(void* arg)
+{
+    Worker* worker = arg;
+    Job* job;
+
+    self = worker->index;
+    for (;;)
+    {
+        // parked workers wait apart, so wake only reaches active ones
+        if (self >= __atomic_load_n(&active_count, __ATOMIC_RELAXED))
+        {
+            pthread_mutex_lock(&sleep_lock);
+            if (__atomic_load_n(&queued, __ATOMIC_SEQ_CST) > 0)
+            {
+                pthread_cond_signal(&wake); // pass on a wakeup meant for work
+            }
+            while (self >= active_count && !stopping)
+            {
+                pthread_cond_wait(&unpark, &sleep_lock);
+            }
+            pthread_mutex_unlock(&sleep_lock);
+        }
+
+        job = take_job(self);
+        if (job)
+        {
+            run(job);
+            continue;
+        }
+
+        pthread_mutex_lock(&sleep_lock);
+        if (__atomic_load_n(&queued, __ATOMIC_SEQ_CST) == 0)
+        {
+            if (stopping)
+            {
+                pthread_mutex_unlock(&sleep_lock);
+                break;
+            }
+            pthread_cond_wait(&wake, &sleep_lock);
+        }
+        pthread_mutex_unlock(&sleep_lock);
+    }
+    return NULL;
+}
+
+void jobs_init(int count)
+{
+    int idx;
+    int priority;
+
+    if (count <= 0)
+    {
+        count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (count < 1)
+    {
+        count = 1;
+    }
+    if (count > MAX_WORKERS)
+    {
+        count = MAX_WORKERS;
+    }
+
+    worker_count = count;
+    active_count = count;
+    stopping = 0;
+    for (idx = 0; idx < count; idx++)
+    {
+        workers[idx].index = idx;
+        pthread_mutex_init(&workers[idx].lock, NULL);
+        for (priority = 0; priority < JOB_PRIORITIES; priority++)
+        {
+            workers[idx].deques[priority].jobs =
+                malloc(MIN_DEQUE_SIZE * sizeof(Job*));
+            workers[idx].deques[priority].head = 0;
+            workers[idx].deques[priority].count = 0;
+            workers[idx].deques[priority].capacity = MIN_DEQUE_SIZE;
+        }
+    }
+    for (idx = 0; idx < count; idx++)
+    {
+        pthread_create(&workers[idx].thread, NULL, worker_main, &workers[idx]);
+    }
+}
+
+void jobs_shutdown()
+{
+    int idx;
+    int priority;
+
+    pthread_mutex_lock(&sleep_lock);
+    stopping = 1;
+    pthread_cond_broadcast(&wake);
+    pthread_cond_broadcast(&unpark);
+    pthread_mutex_unlock(&sleep_lock);
+
+    for (idx = 0; idx < worker_count; idx++)
+    {
+        pthread_join(workers[idx].thread, NULL);
+    }
+    for (idx = 0; idx < worker_count; idx++)
+    {
+        for (priority = 0; priority < JOB_PRIORITIES; priority++)
+        {
+            free(workers[idx].deques[priority].jobs);
+        }
+        pthread_mutex_destroy(&workers[idx].lock);
+    }
+    worker_count = 0;
+}
+
+int jobs_worker_count()
+{
+    return worker_count;
+}
+
+void jobs_set_concurrency(int count)
+{
+    if (count < 1)
+    {
+        count = 1;
+    }
+    if (count > worker_count)
+    {
+        count = worker_count;
+    }
+    pthread_mutex_lock(&sleep_lock);
+    __atomic_store_n(&active_count, count, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&unpark);
+    pthread_mutex_unlock(&sleep_lock);
+}
+
+Job* job_create(JobFunc func, void* arg, int priority)
+{
+    Job* new_job;
+
+    new_job = malloc(sizeof(Job));
+    new_job->func = func;
+    new_job->arg = arg;
+    new_job->check = NULL;
+    new_job->priority = priority;
+    new_job->state = JOB_WAITING;
+    new_job->canceled = 0;
+    new_job->unfinished = 1; // released by job_submit()
+    new_job->refs = 1; // caller's reference
+    new_job->dependents = NULL;
+    new_job->dependent_count = 0;
+    new_job->dependent_capacity = 0;
+    pthread_mutex_init(&new_job->lock, NULL);
+    pthread_cond_init(&new_job->finished, NULL);
+
+    return new_job;
+}
+
+void job_set_check(Job* job, JobCheck check)
+{
+    job->check = check;
+}
+
+void job_depends_on(Job* job, Job* dependency)
+{
+    pthread_mutex_lock(&dependency->lock);
+    if (dependency->state != JOB_FINISHED)
+    {
+        if (dependency->dependent_count == dependency->dependent_capacity)
+        {
+            dependency->dependent_capacity =
+                dependency->dependent_capacity ? 2 * dependency->dependent_capacity : 4;
+            dependency->dependents = realloc(dependency->dependents,
+                dependency->dependent_capacity * sizeof(Job*));
+        }
+        dependency->dependents[dependency->dependent_count++] = job;
+        __atomic_add_fetch(&job->refs, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&job->unfinished, 1, __ATOMIC_ACQ_REL);
+    }
+    else if (dependency->canceled)
+    {
+        job_cancel(job);
+    }
+    pthread_mutex_unlock(&dependency->lock);
+}
+
+void job_submit(Job* job)
+{
+    __atomic_add_fetch(&job->refs, 1, __ATOMIC_RELAXED); // scheduler's
+    dependency_done(job);
+}
+
+void job_cancel(Job* job)
+{
+    pthread_mutex_lock(&job->lock);
+    if (job->state == JOB_WAITING || job->state == JOB_QUEUED)
+    {
+        job->canceled = 1;
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+int job_done(Job* job)
+{
+    int done;
+
+    pthread_mutex_lock(&job->lock);
+    done = job->state == JOB_FINISHED;
+    pthread_mutex_unlock(&job->lock);
+    return done;
+}
+
+int job_canceled(Job* job)
+{
+    int canceled;
+
+    pthread_mutex_lock(&job->lock);
+    canceled = job->canceled;
+    pthread_mutex_unlock(&job->lock);
+    return canceled;
+}
+
+void job_wait(Job* job)
+{
+    Job* other;
+
+    while (!job_done(job))
+    {
+        other = take_job(self);
+        if (other)
+        {
+            run(other);
+            continue;
+        }
+
+        // nothing to help with, the job is running or waiting on a
+        // dependency that is
+        pthread_mutex_lock(&job->lock);
+        while (job->state != JOB_FINISHED)
+        {
+            pthread_cond_wait(&job->finished, &job->lock);
+        }
+        pthread_mutex_unlock(&job->lock);
+    }
+}
+
+void job_release(Job* job)
+{
+    if (__atomic_sub_fetch(&job->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        pthread_mutex_destroy(&job->lock);
+        pthread_cond_destroy(&job->finished);
+        free(job->dependents);
+        free(job);
+    }
+}
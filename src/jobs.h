@@ -0,0 +1,122 @@
+/*
+ * A work-stealing job system.
+ *
+ * Each worker thread owns one deque per priority. Workers pop their own
+ * newest jobs first and, when they run dry, steal the oldest jobs of other
+ * workers, highest priority first. Jobs may depend on other jobs: a job is
+ * only queued once every job it depends on has finished. A job can be
+ * canceled before it runs, either explicitly with job_cancel() or by a check
+ * function that is asked right before the job would run. Canceling a job
+ * cancels every job that depends on it.
+ *
+ * Typical use (meshing a chunk once it and its neighbours are ready):
+ *
+ *   Job* mesh = job_create(mesh_func, chunk, JOB_PRIORITY_HIGH);
+ *   job_set_check(mesh, chunk_still_wanted);
+ *   job_depends_on(mesh, chunk_light_job);
+ *   for each neighbour n: job_depends_on(mesh, n_light_job);
+ *   job_submit(mesh);
+ */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#define JOB_PRIORITY_HIGH 0
+#define JOB_PRIORITY_NORMAL 1
+#define JOB_PRIORITY_LOW 2
+#define JOB_PRIORITIES 3
+
+#define MAX_WORKERS 64
+
+/*
+ * Body of a job. Called exactly once per submitted job, on a worker thread.
+ *
+ * @arg: argument given to job_create().
+ * @canceled: 1 if the job was canceled and should only release its
+ *   resources, 0 if it should do its work.
+ */
+typedef void (*JobFunc)(void* arg, int canceled);
+
+/*
+ * Asked right before a job runs. Return 0 to cancel the job.
+ */
+typedef int (*JobCheck)(void* arg);
+
+typedef struct JobTag Job;
+
+/*
+ * Start the worker threads.
+ *
+ * @workers: number of worker threads, 0 for one per core.
+ */
+void jobs_init(int workers);
+
+/*
+ * Finish all queued jobs and stop the worker threads.
+ */
+void jobs_shutdown();
+
+/*
+ * Get the number of worker threads.
+ */
+int jobs_worker_count();
+
+/*
+ * Let only @count worker threads run jobs, the others sleep until the
+ * limit goes back up. Jobs already queued are still run by the others.
+ */
+void jobs_set_concurrency(int count);
+
+/*
+ * Create a job. The caller holds a reference to the job until it calls
+ * job_release(). The job does not run until job_submit() is called.
+ *
+ * @priority: JOB_PRIORITY_*.
+ */
+Job* job_create(JobFunc func, void* arg, int priority);
+
+/*
+ * Set the function asked right before @job runs. Must be called before
+ * job_submit().
+ */
+void job_set_check(Job* job, JobCheck check);
+
+/*
+ * Make @job wait for @dependency to finish. Must be called before
+ * job_submit(@job). If @dependency is canceled, so is @job.
+ */
+void job_depends_on(Job* job, Job* dependency);
+
+/*
+ * Hand a job to the scheduler. It is queued as soon as its dependencies
+ * have finished.
+ */
+void job_submit(Job* job);
+
+/*
+ * Cancel a job that has not started yet. Has no effect on jobs that are
+ * already running or finished.
+ */
+void job_cancel(Job* job);
+
+/*
+ * Check if a job has finished (ran or was canceled).
+ */
+int job_done(Job* job);
+
+/*
+ * Check if a job was canceled. Only meaningful once job_done() is true.
+ */
+int job_canceled(Job* job);
+
+/*
+ * Block until a job has finished, running other jobs meanwhile.
+ */
+void job_wait(Job* job);
+
+/*
+ * Drop the caller's reference to a job.
+ */
+void job_release(Job* job);
+
+#endif
@@ -7,18 +7,50 @@
  *   Up: y+
  *   Down: y-
  *
+ * Usage:
+ *   voxography                   play locally
+ *   voxography --server ADDRESS  run a headless chunk server
+ *   voxography --connect ADDRESS play on a chunk server
+ *   voxography --import FILE [X Y Z]
+ *                                import a heightmap .png or a .vox model
+ *                                at block X Y Z, see importer.h
+ *   voxography --map X0 Z0 X1 Z1 render the overview map of a box of block
+ *                                columns, see map.h
+ * where ADDRESS is "unix:<path>" or "<host>:<port>", see net.h.
+ *
  * Written by Max Hanson, November 2019 -> _
  */
 
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
 #include "util.h"
 #include "matrix.h"
+#include "asyncio.h"
+#include "budget.h"
+#include "chunk.h"
+#include "client.h"
+#include "collide.h"
+#include "drawlist.h"
+#include "faces.h"
+#include "governor.h"
+#include "importer.h"
+#include "input.h"
+#include "jobs.h"
+#include "map.h"
+#include "mesh.h"
+#include "meshcache.h"
+#include "pipeline.h"
+#include "residency.h"
+#include "server.h"
+#include "storage.h"
+#include "terrain.h"
+#include "world.h"
 #include "../deps/lodepng/lodepng.h"
 
 #define WIREFRAME 0 // set to '1' to draw blocks as a wireframe
@@ -32,98 +64,129 @@
 #define BLOCK_VERTEX_SHADER_PATH "shaders/vertex_shader.glsl"
 #define BLOCK_FRAGMENT_SHADER_PATH "shaders/fragment_shader.glsl"
 #define MATRIX_SHADER_NAME "MVP"
-#define TEXTURE_ATLAS_PATH "./assets/textures/texture_atlas.png"
-// 12 triangles, 3 vtxs each -> 36 vtxs
-#define VTXS_PER_BLOCK 36
-#define CHUNK_SIZE 16 // 1 chunk: 16x16x16 blocks
-#define HUNK_SIZE 16 // 1 hunk: 16x16x16 chunks
-
-#define COPY_VERTEX(v, vertices);            \
-    vertices[0] = v[0];                      \
-    vertices[1] = v[1];                      \
-    vertices[2] = v[2];                      \
-    vertices = vertices + 3;
-
-#define COPY_TEXCOORD(t, texcoords); \
-    texcoords[0] = t[0];             \
-    texcoords[1] = t[1];             \
-    texcoords = texcoords + 2;
-
-
-typedef struct BlockTag
-{
-    GLuint vertex_array_id;
-    GLuint vertex_buffer_id;
-    GLuint texcoord_buffer_id;
-} Block;
-
-typedef struct ChunkTag
-{
-    // see notebook p. 30 drawings
-    Block* blocks[CHUNK_SIZE][CHUNK_SIZE][CHUNK_SIZE]; // array of blocks. Starts at a
-    int a[3]; // coord of main corner (top, northeast)
-} Chunk;
+#define ORIGIN_SHADER_NAME "origin"
+#define OVERDRAW_SHADER_NAME "overdraw"
+#define VIEW_CHUNKS 2 // starting view radius in chunks, see governor.h
+#define MAX_VIEW_CHUNKS 6 // largest view radius in chunks
+#define KEEP_CHUNKS 8 // radius in chunks that stays loaded
+#define STATS_INTERVAL 5.0f // seconds between stats lines on stdout
+#define WORKERS 0 // worker threads, 0 for one per core
+#define CAMERA_HALF_SIZE 0.3f // half the edge of the camera's collision box
+#define GPU_TIMER_QUERIES 4 // frames a GPU time may lag behind
+#define MOUSE_SENSITIVITY 0.002f // radians per mouse count
+#define WALK_SPEED 1.0f // blocks per second
 
 /*
- * Update the camera's position based on by current input.
+ * Update the camera's position based on the keys held down.
  *
  * @p: point to array of the current x, y, z of the camera. Will be updated.
+ * @v: point to array that receives the camera's velocity (blocks/sec).
+ * @rx @ry: current rx, ry of camera.
+ */
+void move_camera(float* p, float* v, float rx, float ry);
+
+/*
+ * Turn the camera by the mouse motion since the last call. Called as late
+ * as possible in a frame, see input.h.
+ *
  * @rx @ry: point to the current rx, ry of camera. Will be updated.
  */
-void update_camera(float* p, float* rx, float* ry);
+void turn_camera(float* rx, float* ry);
 /*
  * Initialize GLFW, create the window (@w), and initialize GLEW.
  */
 void init_opengl();
+
 /*
- * Compute the vertices for the triangles of a block.
+ * Move a chunk onto another render path. The face buffer is built right
+ * away, a baked mesh is requested from the pipeline and replaces the face
+ * buffer once it arrives.
  *
- * @a: array of 3 ints, position of vertex of the block most in the
- *   z- direction, the y+ direction, and x- direction. Its the topmost,
- *   northwest vtx of the block.
- * @vertex_data: array of 108 floats. Will contain triangle vertices.
+ * @path: RENDER_PATH_*.
  */
-void comp_block_vertex_data(const int* a, float* vertex_data);
+void set_render_path(Chunk* chunk, int path);
 
 /*
- * Compute the texcoords for a voxel.
- *
- * @texture_data: array of 72 floats (36 texcoords). Will contain texcoords.
+ * Adopt a chunk's freshly built mesh and request a new one if its blocks
+ * changed. Uploads count against uploads_left; meshes over budget wait for
+ * a later frame.
  */
-void comp_block_texture_data(float* texture_data);
+void prepare_chunk(Chunk* chunk, int hidden);
 
 /*
- * Construct a block object.
- *
- * @x, @y, @z: coordinate of top-northeast corner of the block.
+ * Draw a chunk.
  */
-Block* construct_block(int x, int y, int z);
+void draw_chunk(Chunk* chunk);
 
 /*
- * Construct a chunk object.
+ * Draw the chunks of the draw list, nearest first. With the depth
+ * pre-pass on, the chunks are drawn to the depth buffer first and only
+ * the nearest fragment of each pixel is shaded.
  *
- * @x, @y, @z: coordinate of top-northeast corner of chunk.
+ * Returns the fragments shaded per pixel of an earlier frame if the
+ * overdraw view is on, see overdraw_end().
  */
-Chunk* construct_chunk(int x, int y, int z);
+float draw_chunks();
 
 /*
- * Add a block to a chunk.
- *
- * @dx, @dy, @dz: relative coordinates of the block from top-northeast corner
- *   of the chunk.
+ * Switch the overdraw view on or off. In the overdraw view every shaded
+ * fragment adds the same grey, so brighter pixels were shaded more often.
+ */
+void set_overdraw_view(int on);
+
+/*
+ * Start counting the fragments shaded in a frame.
+ */
+void overdraw_begin();
+
+/*
+ * Stop counting the fragments shaded in a frame. Returns the fragments per
+ * pixel of a frame GPU_TIMER_QUERIES - 1 frames ago, 0 while that is not
+ * known.
  */
-void add_block(Chunk* chunk, Block* block, int dx, int dy, int dz);
+float overdraw_end();
+
+/*
+ * Start timing the GPU work of a frame.
+ */
+void gpu_timer_begin();
+
+/*
+ * Stop timing the GPU work of a frame. Returns the GPU time (ms) of a frame
+ * GPU_TIMER_QUERIES - 1 frames ago, 0 while that is not known, so reading
+ * it never waits for the GPU.
+ */
+float gpu_timer_end();
 
 GLFWwindow* w;
 GLint texcoord_attrib_idx;
 GLint position_attrib_idx;
-
-int main()
+GLuint block_shaders_id;
+GLuint face_shaders_id;
+GLuint block_matrix_id;
+GLuint face_matrix_id;
+GLint face_origin_id;
+GLint block_overdraw_id;
+GLint face_overdraw_id;
+GLuint gpu_queries[GPU_TIMER_QUERIES];
+int gpu_frame = 0;
+GLuint overdraw_queries[GPU_TIMER_QUERIES];
+int overdraw_frame = 0;
+DrawList* draw_list; // chunks to draw this frame
+int uploads_left; // mesh uploads left this frame
+
+int main(int argc, char** argv)
 {
-    GLuint block_shaders_id;
-    GLuint matrix_id;
-    Chunk chunk;
-    Block* block_cursor;
+    const char* server_address = NULL; // play on a server if set
+    World* world;
+    Chunk* chunk;
+    int chunk_idx;
+    int path;
+    int hidden;
+    int overdraw_view = 0;
+    float overdraw;
+    float overdraw_sum = 0.0f; // fragments per pixel, summed since stats
+    int overdraw_frames = 0;
 
     // textures
     int error;
@@ -134,18 +197,90 @@ int main()
 
     // camera information
     float matrix[16];
-    float cam_p[3] = {-1.0f, 1.5f, 2.0f};
+    float cam_p[3] = {-1.0f, TERRAIN_BASE + TERRAIN_MAX_AMPLITUDE + 1.5f,
+                      2.0f}; // above the highest terrain
+    float cam_v[3] = {0.0f, 0.0f, 0.0f};
+    float cam_half[3] = {CAMERA_HALF_SIZE, CAMERA_HALF_SIZE, CAMERA_HALF_SIZE};
+    float cam_prev[3];
+    float cam_move[3];
     float cam_rx = 0.5f;
     float cam_ry = -0.8f;
-    int rad = 40;
+    const GovernorState* quality;
+    int import_at[3] = {0, TERRAIN_BASE, 0};
+    int map_min[2];
+    int map_max[2];
+
+    // timing
+    float prev_time = 0.0f;
+    float current_time;
+    float stats_time = 0.0f;
+    float cpu_ms;
+    float gpu_ms;
+
+    if (argc == 3 && strcmp(argv[1], "--server") == 0)
+    {
+        return server_run(argv[2]);
+    }
+    if ((argc == 3 || argc == 6) && strcmp(argv[1], "--import") == 0)
+    {
+        if (argc == 6)
+        {
+            import_at[0] = atoi(argv[3]);
+            import_at[1] = atoi(argv[4]);
+            import_at[2] = atoi(argv[5]);
+        }
+        return import_run(argv[2], import_at);
+    }
+    if (argc == 6 && strcmp(argv[1], "--map") == 0)
+    {
+        map_min[0] = atoi(argv[2]);
+        map_min[1] = atoi(argv[3]);
+        map_max[0] = atoi(argv[4]);
+        map_max[1] = atoi(argv[5]);
+        return map_run(map_min, map_max);
+    }
+    if (argc == 3 && strcmp(argv[1], "--connect") == 0)
+    {
+        server_address = argv[2];
+    }
+    else if (argc != 1)
+    {
+        fprintf(stderr, "Usage: %s [--server|--connect ADDRESS]\n"
+                "       %s --import FILE [X Y Z]\n"
+                "       %s --map X0 Z0 X1 Z1\n", argv[0], argv[0], argv[0]);
+        return 1;
+    }
 
     init_opengl();
+    jobs_init(WORKERS);
+    if (server_address == NULL)
+    {
+        if (async_init(0) != 0 || storage_init(WORLD_DIR) != 0)
+        {
+            fprintf(stderr, "Could not set up world storage.\n");
+            return 1;
+        }
+        printf("I/O backend: %s\n", async_backend());
+    }
+    if (mesh_cache_init(MESH_CACHE_DIR) != 0)
+    {
+        fprintf(stderr, "Mesh cache disabled.\n");
+    }
 
     // load/use shaders
     block_shaders_id = load_program(BLOCK_VERTEX_SHADER_PATH,
                                     BLOCK_FRAGMENT_SHADER_PATH);
     glUseProgram(block_shaders_id);
-    matrix_id = glGetUniformLocation(block_shaders_id, MATRIX_SHADER_NAME);
+    block_matrix_id = glGetUniformLocation(block_shaders_id,
+                                           MATRIX_SHADER_NAME);
+    face_shaders_id = load_program(FACE_VERTEX_SHADER_PATH,
+                                   BLOCK_FRAGMENT_SHADER_PATH);
+    face_matrix_id = glGetUniformLocation(face_shaders_id, MATRIX_SHADER_NAME);
+    face_origin_id = glGetUniformLocation(face_shaders_id, ORIGIN_SHADER_NAME);
+    block_overdraw_id = glGetUniformLocation(block_shaders_id,
+                                             OVERDRAW_SHADER_NAME);
+    face_overdraw_id = glGetUniformLocation(face_shaders_id,
+                                            OVERDRAW_SHADER_NAME);
 
     // bind shader inputs
     texcoord_attrib_idx = glGetAttribLocation(block_shaders_id, "texcoord");
@@ -158,6 +293,13 @@ int main()
     {
         fprintf(stderr, "Couldn't bind attrib 'position' to shaders.\n");
     }
+    if (glGetAttribLocation(face_shaders_id, "corner") == -1 ||
+        glGetAttribLocation(face_shaders_id, "face") == -1)
+    {
+        fprintf(stderr, "Couldn't bind attribs 'corner'/'face' to shaders.\n");
+    }
+    faces_init(glGetAttribLocation(face_shaders_id, "corner"),
+               glGetAttribLocation(face_shaders_id, "face"));
 
     // load texture atlas into memory
     error = lodepng_decode32_file(&atlas_image, &width, &height, TEXTURE_ATLAS_PATH);
@@ -178,125 +320,232 @@ int main()
         GL_UNSIGNED_BYTE, atlas_image);
     free(atlas_image);
 
-    // create chunk
-    for (int i = 0; i < 16; i++)
+    // chunks are loaded around the camera by the pipeline, or streamed by
+    // the server and only meshed by the pipeline
+    world = construct_world();
+    pipeline_init(world, generate_terrain, NULL, VIEW_CHUNKS, KEEP_CHUNKS);
+    if (server_address && client_init(world, server_address, VIEW_CHUNKS) != 0)
     {
-        for (int j = 0; j < 16; j++)
-        {
-            for (int k = 0; k < 16; k++)
-            {
-                chunk.blocks[i][j][k] = NULL;
-            }
-        }
+        return 1;
+    }
+    governor_init(GOVERNOR_TARGET_MS, VIEW_CHUNKS, MAX_VIEW_CHUNKS,
+                  jobs_worker_count());
+    quality = governor_state();
+    glGenQueries(GPU_TIMER_QUERIES, gpu_queries);
+    glGenQueries(GPU_TIMER_QUERIES, overdraw_queries);
+    draw_list = construct_draw_list();
+
+    if (WIREFRAME)
+    {
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
     }
-    // NOTE: block coordinates are independent of chunk coordinates. Right now chunk coordinates
-    // are not used, but block coordinates are manually lined up with chunk coordinates.
-    chunk.blocks[0][0][15] = construct_block(0, 0, 0);
-    chunk.blocks[1][0][15] = construct_block(1, 0, 0);
 
     // gameloop
     while (glfwGetKey(w, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
            glfwWindowShouldClose(w) == 0)
     {
+        // WAIT FOR THE FRAME TO START //
+        input_pace(quality->target_ms * 0.001, quality->cpu_ms * 0.001);
+        glfwPollEvents();
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        current_time = (float)glfwGetTime();
+        gpu_timer_begin();
+        uploads_left = quality->upload_budget;
+
+        // MOVE THE CAMERA //
+        vec_multiply(cam_prev, 1.0f, cam_p);
+        move_camera(cam_p, cam_v, cam_rx, cam_ry);
+        // move the camera again, this time stopping at solid blocks
+        vec_sub(cam_move, cam_p, cam_prev);
+        vec_multiply(cam_p, 1.0f, cam_prev);
+        collide_box(world, cam_p, cam_half, cam_move);
+
+        // LOAD CHUNKS AROUND THE CAMERA //
+        if (server_address)
+        {
+            if (client_update(cam_p) != 0)
+            {
+                fprintf(stderr, "Lost connection to server.\n");
+                break;
+            }
+        }
+        else
+        {
+            async_poll();
+            pipeline_update(cam_p);
+            pipeline_prefetch(cam_p, cam_v);
+            async_submit();
+        }
+        residency_update(world, cam_p, current_time);
+        budget_update(world, current_time);
+
+        // PREPARE EACH CHUNK //
+        draw_list_clear(draw_list);
+        chunk_idx = 0;
+        while ((chunk = world_next(world, &chunk_idx)) != NULL)
+        {
+            chunk_tick(chunk, current_time - prev_time);
+            path = chunk_pick_render_path(chunk);
+            if (path != chunk->render_path)
+            {
+                set_render_path(chunk, path);
+            }
+            hidden = world_chunk_hidden(world, chunk);
+            prepare_chunk(chunk, hidden);
+            if (!hidden && (chunk->faces || chunk->mesh))
+            {
+                draw_list_add(draw_list, chunk);
+            }
+        }
+        draw_list_sort(draw_list, cam_p);
+        prev_time = current_time;
 
-        // UPDATE THE CAMERA //
-        update_camera(cam_p, &cam_rx, &cam_ry);
+        // TURN THE CAMERA, AS LATE AS POSSIBLE //
+        glfwPollEvents();
+        turn_camera(&cam_rx, &cam_ry);
         set_matrix_3d(matrix, WIDTH, HEIGHT, cam_p[0], cam_p[1], cam_p[2],
-                      cam_rx, cam_ry, FOV, 0, rad);
-        glUniformMatrix4fv(matrix_id, 1, GL_FALSE, matrix);
+                      cam_rx, cam_ry, FOV, 0,
+                      (quality->radius + 1) * CHUNK_SIZE);
+        glUseProgram(block_shaders_id);
+        glUniformMatrix4fv(block_matrix_id, 1, GL_FALSE, matrix);
+        glUseProgram(face_shaders_id);
+        glUniformMatrix4fv(face_matrix_id, 1, GL_FALSE, matrix);
+
+        // DRAW EACH CHUNK, NEAREST FIRST //
+        if (input_overdraw() != overdraw_view)
+        {
+            overdraw_view = input_overdraw();
+            set_overdraw_view(overdraw_view);
+            overdraw_frame = 0; // results of older frames are not ours
+        }
+        overdraw = draw_chunks();
+        if (overdraw > 0.0f)
+        {
+            overdraw_sum += overdraw;
+            overdraw_frames++;
+        }
 
-        // DRAW EACH BLOCK //
-        for (int i = 0; i < 16; i++)
+        if (current_time - stats_time > STATS_INTERVAL)
         {
-            for (int j = 0; j < 16; j++)
+            residency_print(stdout);
+            budget_print(stdout);
+            governor_print(stdout);
+            input_print_latency(stdout);
+            mesh_cache_print(stdout);
+            if (overdraw_frames > 0)
             {
-                for (int k = 0; k < 16; k++)
-                {
-                    block_cursor = chunk.blocks[i][j][k];
-                    if (WIREFRAME)
-                    {
-                        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-                    }
-                    if (block_cursor != NULL)
-                    {
-                        glBindVertexArray(block_cursor->vertex_array_id);
-                        glDrawArrays(GL_TRIANGLES, 0, VTXS_PER_BLOCK);
-                        glBindVertexArray(0);
-                    }
-                }
+                printf("overdraw: %.2f fragments per pixel, depth pre-pass "
+                       "%s\n", overdraw_sum / overdraw_frames,
+                       input_depth_prepass() ? "on" : "off");
+                overdraw_sum = 0.0f;
+                overdraw_frames = 0;
             }
+            printf("columns: %d cached\n", column_count());
+            stats_time = current_time;
+        }
+
+        // HOLD THE FRAME TIME //
+        gpu_ms = gpu_timer_end();
+        cpu_ms = ((float)glfwGetTime() - current_time) * 1000.0f;
+        if (governor_update(cpu_ms, gpu_ms, current_time))
+        {
+            pipeline_set_radius(quality->radius);
+            if (server_address)
+            {
+                client_set_radius(quality->radius);
+            }
+            jobs_set_concurrency(quality->workers);
+            governor_print(stdout);
         }
 
         glfwSwapBuffers(w);
-        glfwPollEvents();
+        input_swapped();
+    }
+
+    if (server_address)
+    {
+        client_shutdown();
+        return 0;
     }
+
+    // save edits before quitting
+    storage_flush(world);
+    async_shutdown();
+    storage_shutdown();
 }
 
-void update_camera(float* p, float* rx, float* ry)
+void move_camera(float* p, float* v, float rx, float ry)
 {
     static float prev_time = 0.0f;
-    static float f[3] = {0, 0, -1}; // points into screen
-    static float r[3] = {1, 0, 0}; // points to the right of the screen
+    float f[3]; // points into screen
+    float r[3]; // points to the right of the screen
     float tmp[3];
-    const float mouse_speed = 0.1f; // how fast camera rotates
-    const float walk_speed = 1.0f; // how fast camera translates
+    float prev_p[3];
     float current_time;
-    float delta_x;
-    float delta_y;
     float delta_t;
-    double mouse_x;
-    double mouse_y;
 
-    glfwGetCursorPos(w, &mouse_x, &mouse_y);
-    glfwSetCursorPos(w, WIDTH / 2, HEIGHT / 2);
-    delta_x = (float)mouse_x - (WIDTH / 2);
-    delta_y = (HEIGHT / 2) - (float)mouse_y;
     current_time = (float)glfwGetTime();
     delta_t = current_time - prev_time;
     prev_time = current_time;
+    prev_p[0] = p[0];
+    prev_p[1] = p[1];
+    prev_p[2] = p[2];
+
+    // UPDATE FORWARD VEC //
+    f[0] = sinf(rx);
+    f[1] = sinf(ry); // to make movement horizontal, set to 0
+    f[2] = -1.0f * cosf(rx);
+    normalize(&f[0], &f[1], &f[2]);
+
+    // UPDATE RIGHT VEC //
+    r[0] = sinf(rx + (PI  * 0.5));
+    r[1] = 0.0f;
+    r[2] = -1.0f * cosf(rx + (PI * 0.5));
+    normalize(&r[0], &r[1], &r[2]);
 
     // UPDATE POSN //
     if (glfwGetKey(w, GLFW_KEY_W) == GLFW_PRESS)
     {
         // p = p + (d * delta_t * speed)
-        vec_multiply(tmp, delta_t * walk_speed, f);
+        vec_multiply(tmp, delta_t * WALK_SPEED, f);
         vec_add(p, p, tmp);
     }
     if (glfwGetKey(w, GLFW_KEY_A) == GLFW_PRESS)
     {
         // p = p - (r * delta_t * speed)
-        vec_multiply(tmp, delta_t * walk_speed, r);
+        vec_multiply(tmp, delta_t * WALK_SPEED, r);
         vec_sub(p, p, tmp);
     }
     if (glfwGetKey(w, GLFW_KEY_S) == GLFW_PRESS)
     {
         // p = p - (d * delta_t * speed)
-        vec_multiply(tmp, delta_t * walk_speed, f);
+        vec_multiply(tmp, delta_t * WALK_SPEED, f);
         vec_sub(p, p, tmp);
     }
     if (glfwGetKey(w, GLFW_KEY_D) == GLFW_PRESS)
     {
         // p = p + (r * delta_t * speed)
-        vec_multiply(tmp, delta_t * walk_speed, r);
+        vec_multiply(tmp, delta_t * WALK_SPEED, r);
         vec_add(p, p, tmp);
     }
 
-    // UPDATE LOOK DIRECTION //
-    *rx += mouse_speed * delta_t * delta_x;
-    *ry += mouse_speed * delta_t * delta_y;
+    // UPDATE VELOCITY //
+    if (delta_t > 0.0f)
+    {
+        // v = (p - prev_p) / delta_t
+        vec_sub(tmp, p, prev_p);
+        vec_multiply(v, 1.0f / delta_t, tmp);
+    }
+}
 
-    // UPDATE FORWARD VEC //
-    f[0] = sinf(*rx);
-    f[1] = sinf(*ry); // to make movement horizontal, set to 0
-    f[2] = -1.0f * cosf(*rx);
-    normalize(&f[0], &f[1], &f[2]);
+void turn_camera(float* rx, float* ry)
+{
+    float delta_x;
+    float delta_y;
 
-    // UPDATE RIGHT VEC //
-    r[0] = sinf(*rx + (PI  * 0.5));
-    r[1] = 0.0f;
-    r[2] = -1.0f * cosf(*rx + (PI * 0.5));
-    normalize(&r[0], &r[1], &r[2]);
+    input_take_motion(&delta_x, &delta_y);
+    *rx += MOUSE_SENSITIVITY * delta_x;
+    *ry -= MOUSE_SENSITIVITY * delta_y; // screen y points down
 }
 
 void init_opengl()
@@ -320,7 +569,6 @@ void init_opengl()
         exit(-1);
     }
     glfwMakeContextCurrent(w);
-    glfwSetCursorPos(w, WIDTH / 2, HEIGHT / 2); // place cursor at center
 
     // initialize glew
     if (glewInit() != GLEW_OK)
@@ -334,186 +582,240 @@ void init_opengl()
     glDepthFunc(GL_LESS);
 
     glfwSetInputMode(w, GLFW_STICKY_KEYS, GL_TRUE);
+    input_init(w);
 }
 
-void comp_block_vertex_data(const int* a, float* vertex_data)
+void set_render_path(Chunk* chunk, int path)
 {
-    // TODO use VBO indexing
-    // see project notebook p.9 for drawings. Transfer in when finalized.
-
-    const int b[3] = {a[0]+1, a[1]  , a[2]  };
-    const int c[3] = {a[0]  , a[1]  , a[2]-1};
-    const int d[3] = {a[0]+1, a[1]  , a[2]-1};
-    const int e[3] = {a[0]  , a[1]-1, a[2]  };
-    const int f[3] = {a[0]+1, a[1]-1, a[2]  };
-    const int g[3] = {a[0]  , a[1]-1, a[2]-1};
-    const int h[3] = {a[0]+1, a[1]-1, a[2]-1};
-
-    // face 1
-    COPY_VERTEX(b, vertex_data); // b-a-f
-    COPY_VERTEX(a, vertex_data);
-    COPY_VERTEX(f, vertex_data);
-    COPY_VERTEX(e, vertex_data); // e-f-a
-    COPY_VERTEX(f, vertex_data);
-    COPY_VERTEX(a, vertex_data);
-    // face 2
-    COPY_VERTEX(a, vertex_data); // a-c-e
-    COPY_VERTEX(c, vertex_data);
-    COPY_VERTEX(e, vertex_data);
-    COPY_VERTEX(g, vertex_data); // g-e-c
-    COPY_VERTEX(e, vertex_data);
-    COPY_VERTEX(c, vertex_data);
-    // face 3
-    COPY_VERTEX(c, vertex_data); // c-d-g
-    COPY_VERTEX(d, vertex_data);
-    COPY_VERTEX(g, vertex_data);
-    COPY_VERTEX(h, vertex_data); // h-g-d
-    COPY_VERTEX(g, vertex_data);
-    COPY_VERTEX(d, vertex_data);
-    // face 4
-    COPY_VERTEX(d, vertex_data); // d-b-h
-    COPY_VERTEX(b, vertex_data);
-    COPY_VERTEX(h, vertex_data);
-    COPY_VERTEX(f, vertex_data); // f-h-b
-    COPY_VERTEX(h, vertex_data);
-    COPY_VERTEX(b, vertex_data);
-    // face 5
-    COPY_VERTEX(a, vertex_data); // a-b-c
-    COPY_VERTEX(b, vertex_data);
-    COPY_VERTEX(c, vertex_data);
-    COPY_VERTEX(d, vertex_data); // d-c-b
-    COPY_VERTEX(c, vertex_data);
-    COPY_VERTEX(b, vertex_data);
-    // face 6
-    COPY_VERTEX(e, vertex_data); // e-f-g
-    COPY_VERTEX(f, vertex_data);
-    COPY_VERTEX(g, vertex_data);
-    COPY_VERTEX(g, vertex_data); // g-h-f
-    COPY_VERTEX(h, vertex_data);
-    COPY_VERTEX(f, vertex_data);
+    if (path == RENDER_PATH_FACES)
+    {
+        chunk_touch(chunk);
+        // the baked mesh is not needed while the chunk is on the face path
+        if (chunk->mesh)
+        {
+            destroy_mesh(chunk->mesh);
+            chunk->mesh = NULL;
+        }
+        if (chunk->faces == NULL)
+        {
+            chunk->faces = construct_face_buffer();
+        }
+        face_buffer_build(chunk->faces, chunk);
+    }
+    else
+    {
+        // keep drawing the faces until the new mesh arrives
+        chunk->dirty = 1;
+    }
+    chunk->render_path = path;
 }
 
-void comp_block_texture_data(float* texture_data)
+void prepare_chunk(Chunk* chunk, int hidden)
 {
-    // see projects notebook p.9 for drawings. Transfer in when finalized.
-    const float a[2] = {0.0f, 0.8750f}; // topleft
-    const float b[2] = {0.0625f, 0.8750f}; // topright
-    const float c[2] = {0.0f, 0.9375f}; // bottomleft
-    const float d[2] = {0.0625f, 0.9375f}; // bottomright
-
-    COPY_TEXCOORD(a, texture_data);
-    COPY_TEXCOORD(b, texture_data);
-    COPY_TEXCOORD(c, texture_data);
-    COPY_TEXCOORD(d, texture_data);
-    COPY_TEXCOORD(c, texture_data);
-    COPY_TEXCOORD(b, texture_data);
-
-    COPY_TEXCOORD(a, texture_data);
-    COPY_TEXCOORD(b, texture_data);
-    COPY_TEXCOORD(c, texture_data);
-    COPY_TEXCOORD(d, texture_data);
-    COPY_TEXCOORD(c, texture_data);
-    COPY_TEXCOORD(b, texture_data);
-
-    COPY_TEXCOORD(a, texture_data);
-    COPY_TEXCOORD(b, texture_data);
-    COPY_TEXCOORD(c, texture_data);
-    COPY_TEXCOORD(d, texture_data);
-    COPY_TEXCOORD(c, texture_data);
-    COPY_TEXCOORD(b, texture_data);
-
-    COPY_TEXCOORD(a, texture_data);
-    COPY_TEXCOORD(b, texture_data);
-    COPY_TEXCOORD(c, texture_data);
-    COPY_TEXCOORD(d, texture_data);
-    COPY_TEXCOORD(c, texture_data);
-    COPY_TEXCOORD(b, texture_data);
-
-    COPY_TEXCOORD(a, texture_data);
-    COPY_TEXCOORD(b, texture_data);
-    COPY_TEXCOORD(c, texture_data);
-    COPY_TEXCOORD(d, texture_data);
-    COPY_TEXCOORD(c, texture_data);
-    COPY_TEXCOORD(b, texture_data);
-
-    COPY_TEXCOORD(a, texture_data);
-    COPY_TEXCOORD(b, texture_data);
-    COPY_TEXCOORD(c, texture_data);
-    COPY_TEXCOORD(d, texture_data);
-    COPY_TEXCOORD(c, texture_data);
-    COPY_TEXCOORD(b, texture_data);
-}
+    Mesh* mesh = NULL;
 
-void comp_chunk_vertex_data();
+    if (uploads_left > 0)
+    {
+        mesh = __atomic_exchange_n(&chunk->pending_mesh, NULL,
+                                   __ATOMIC_ACQ_REL);
+    }
+    if (mesh && !hidden && chunk->render_path == RENDER_PATH_BAKED)
+    {
+        if (chunk->mesh)
+        {
+            destroy_mesh(chunk->mesh);
+        }
+        chunk->mesh = mesh;
+        mesh_upload(mesh, position_attrib_idx, texcoord_attrib_idx);
+        uploads_left -= (mesh->vertex_count > 0);
+        if (chunk->faces)
+        {
+            destroy_face_buffer(chunk->faces);
+            chunk->faces = NULL;
+        }
+    }
+    else if (mesh)
+    {
+        // chunk moved to the face path or got walled in meanwhile
+        destroy_mesh(mesh);
+    }
 
-Block* construct_block(int x, int y, int z)
-{
-    const size_t vertices_size = 108 * sizeof(GLfloat);
-    const size_t texcoords_size = 72 * sizeof(GLfloat);
-    GLfloat vertices[108]; // array of 108 floats (36 points)
-    GLfloat texcoords[72]; // texture (u,v) coordinates into texture atlas
-    Block* new_block;
-    int a[3];
+    // a hidden chunk needs no mesh. It is meshed again below once a
+    // neighbour opens it up.
+    if (hidden && chunk->mesh)
+    {
+        destroy_mesh(chunk->mesh);
+        chunk->mesh = NULL;
+    }
+    if (hidden && chunk->jobs[STAGE_MESH] &&
+        job_done(chunk->jobs[STAGE_MESH]))
+    {
+        job_release(chunk->jobs[STAGE_MESH]);
+        chunk->jobs[STAGE_MESH] = NULL;
+    }
 
-    a[0] = x;
-    a[1] = y;
-    a[2] = z;
+    // bring back what the budget evicted (see budget.h)
+    if (!hidden && chunk->render_path == RENDER_PATH_FACES &&
+        chunk->faces == NULL)
+    {
+        chunk_touch(chunk);
+        chunk->faces = construct_face_buffer();
+        face_buffer_build(chunk->faces, chunk);
+    }
+    if (!hidden && chunk->render_path == RENDER_PATH_BAKED)
+    {
+        if (chunk->mesh && chunk->mesh->vertex_array_id == 0 &&
+            chunk->mesh->vertices && uploads_left > 0)
+        {
+            mesh_upload(chunk->mesh, position_attrib_idx,
+                        texcoord_attrib_idx);
+            uploads_left--;
+        }
+        else if (chunk->mesh == NULL && chunk->jobs[STAGE_MESH] == NULL &&
+                 chunk->wanted == WANT_MESH &&
+                 (stage_done(chunk, STAGE_LIGHT) ||
+                  (chunk->jobs[STAGE_LIGHT] == NULL && chunk->solid_ready)))
+        {
+            // lit, or streamed from a server and never through the stages
+            chunk->dirty = 1;
+        }
+    }
 
-    new_block = malloc(sizeof(Block));
+    if (!hidden && chunk->render_path == RENDER_PATH_BAKED && chunk->dirty &&
+        pipeline_remesh(chunk))
+    {
+        chunk->dirty = 0;
+    }
+}
 
-    comp_block_vertex_data(a, vertices);
-    comp_block_texture_data(texcoords);
+void draw_chunk(Chunk* chunk)
+{
+    chunk->last_visible = residency_now();
+    if (chunk->faces)
+    {
+        glUseProgram(face_shaders_id);
+        glUniform3f(face_origin_id, chunk->a[0], chunk->a[1], chunk->a[2]);
+        face_buffer_upload(chunk->faces);
+        face_buffer_draw(chunk->faces);
+    }
+    else if (chunk->mesh)
+    {
+        glUseProgram(block_shaders_id);
+        mesh_draw(chunk->mesh);
+    }
+}
 
-    glGenVertexArrays(1, &(new_block->vertex_array_id));
-    glBindVertexArray(new_block->vertex_array_id);
+float draw_chunks()
+{
+    float overdraw = 0.0f;
+    int idx;
 
-    // buffer vertex data into VBO
-    glGenBuffers(1, &new_block->vertex_buffer_id);
-    glBindBuffer(GL_ARRAY_BUFFER, new_block->vertex_buffer_id);
-    glBufferData(GL_ARRAY_BUFFER, vertices_size, vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(position_attrib_idx, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    if (input_depth_prepass())
+    {
+        // lay down the depth of the nearest surfaces, without shading
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        for (idx = 0; idx < draw_list->count; idx++)
+        {
+            draw_chunk(draw_list->chunks[idx]);
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
+    }
 
-    // buffer texture coordinate data
-    glGenBuffers(1, &new_block->texcoord_buffer_id);
-    glBindBuffer(GL_ARRAY_BUFFER, new_block->texcoord_buffer_id);
-    glBufferData(GL_ARRAY_BUFFER, texcoords_size, texcoords, GL_STATIC_DRAW);
-    glVertexAttribPointer(texcoord_attrib_idx, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    if (input_overdraw())
+    {
+        overdraw_begin();
+    }
+    for (idx = 0; idx < draw_list->count; idx++)
+    {
+        draw_chunk(draw_list->chunks[idx]);
+    }
+    if (input_overdraw())
+    {
+        overdraw = overdraw_end();
+    }
 
-    glEnableVertexAttribArray(position_attrib_idx);
-    glEnableVertexAttribArray(texcoord_attrib_idx);
+    if (input_depth_prepass())
+    {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+    return overdraw;
+}
 
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+void set_overdraw_view(int on)
+{
+    glUseProgram(block_shaders_id);
+    glUniform1i(block_overdraw_id, on);
+    glUseProgram(face_shaders_id);
+    glUniform1i(face_overdraw_id, on);
+    if (on)
+    {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+    }
+    else
+    {
+        glDisable(GL_BLEND);
+    }
+}
 
-    return new_block;
+void overdraw_begin()
+{
+    glBeginQuery(GL_SAMPLES_PASSED,
+                 overdraw_queries[overdraw_frame % GPU_TIMER_QUERIES]);
 }
 
-Chunk* construct_chunk(int x, int y, int z)
+float overdraw_end()
 {
-    Chunk* new_chunk;
-    int x_idx;
-    int y_idx;
-    int z_idx;
+    GLuint oldest;
+    GLint available = 0;
+    GLuint64 samples;
 
-    new_chunk = malloc(sizeof(Chunk));
+    glEndQuery(GL_SAMPLES_PASSED);
+    overdraw_frame++;
+    if (overdraw_frame < GPU_TIMER_QUERIES)
+    {
+        return 0.0f;
+    }
 
-    // init all blocks to null
-    for (x_idx = 0; x_idx < CHUNK_SIZE; x_idx++)
+    // the query begun next is the oldest one
+    oldest = overdraw_queries[overdraw_frame % GPU_TIMER_QUERIES];
+    glGetQueryObjectiv(oldest, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
     {
-        for (y_idx = 0; y_idx < CHUNK_SIZE; y_idx++)
-        {
-            for (z_idx = 0; z_idx < CHUNK_SIZE; z_idx++)
-            {
-                (new_chunk->blocks)[x_idx][y_idx][z_idx] = 0; // nullify
-            }
-        }
+        return 0.0f;
     }
+    glGetQueryObjectui64v(oldest, GL_QUERY_RESULT, &samples);
+    return (float)samples / (WIDTH * HEIGHT);
+}
 
-    return new_chunk;
+void gpu_timer_begin()
+{
+    glBeginQuery(GL_TIME_ELAPSED, gpu_queries[gpu_frame % GPU_TIMER_QUERIES]);
 }
 
-void add_block(Chunk* chunk, Block* block, int dx, int dy, int dz)
+float gpu_timer_end()
 {
-    (chunk->blocks)[dx][dy][dz] = block;
+    GLuint oldest;
+    GLint available = 0;
+    GLuint64 elapsed;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    gpu_frame++;
+    if (gpu_frame < GPU_TIMER_QUERIES)
+    {
+        return 0.0f;
+    }
+
+    // the query begun next is the oldest one
+    oldest = gpu_queries[gpu_frame % GPU_TIMER_QUERIES];
+    glGetQueryObjectiv(oldest, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+    {
+        return 0.0f;
+    }
+    glGetQueryObjectui64v(oldest, GL_QUERY_RESULT, &elapsed);
+    return (float)elapsed * 1e-6f;
 }
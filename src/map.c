@@ -0,0 +1,655 @@
+/*
+ * Implementation of the overview map renderer.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "map.h"
+#include "chunk.h"
+#include "column.h"
+#include "faces.h"
+#include "jobs.h"
+#include "storage.h"
+#include "terrain.h"
+#include "world.h"
+#include "../deps/lodepng/lodepng.h"
+
+#define PATH_SIZE 256
+#define TILE_PIXELS (MAP_TILE_SIZE * MAP_TILE_SIZE)
+#define SCAN_SIZE (MAP_TILE_SIZE + 1) // a tile and the column/row before it
+#define NO_BLOCK (-0x7fffffff) // height of a column with no block
+#define MIN_CY (MAP_MIN_Y / CHUNK_SIZE - (MAP_MIN_Y % CHUNK_SIZE < 0))
+#define MAX_CY (MAP_MAX_Y / CHUNK_SIZE)
+#define MIN_HY (MIN_CY / HUNK_SIZE - (MIN_CY % HUNK_SIZE < 0))
+#define MAX_HY (MAX_CY / HUNK_SIZE)
+
+typedef struct MapTileTag
+{
+    int level;
+    int t[2]; // tile x, z
+    int dirty; // rendered this run
+    unsigned char* pixels; // RGBA, kept until the parent is rendered
+    Job* job; // NULL if not dirty
+    struct MapTileTag* children[4]; // NULL outside the box or at level 0
+} MapTile;
+
+/*
+ * The tiles of one level that cover the box.
+ */
+typedef struct MapLevelTag
+{
+    int lo[2];
+    int hi[2];
+    MapTile* tiles;
+} MapLevel;
+
+static char map_dir[PATH_SIZE];
+static unsigned char colours[256][3]; // mean atlas colour of each block id
+
+static int floor_div(int a, int b)
+{
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+static void tile_path(char* path, int level, const int* t)
+{
+    snprintf(path, PATH_SIZE, "%s/%d/tile.%d.%d.png", map_dir, level, t[0],
+             t[1]);
+}
+
+static MapTile* level_tile(const MapLevel* level, int tx, int tz)
+{
+    if (tx < level->lo[0] || tx > level->hi[0] || tz < level->lo[1] ||
+        tz > level->hi[1])
+    {
+        return NULL;
+    }
+    return &level->tiles[(tx - level->lo[0]) *
+                         (level->hi[1] - level->lo[1] + 1) +
+                         (tz - level->lo[1])];
+}
+
+/*
+ * Get the mean colour of each block id's atlas tile.
+ */
+static int load_colours()
+{
+    unsigned char* atlas;
+    unsigned int width;
+    unsigned int height;
+    unsigned int error;
+    unsigned long sum[3];
+    int tile_size;
+    int tile;
+    int id;
+    int x;
+    int y;
+    int ch;
+    const unsigned char* pixel;
+
+    error = lodepng_decode32_file(&atlas, &width, &height, TEXTURE_ATLAS_PATH);
+    if (error)
+    {
+        fprintf(stderr, "Could not load texture at '%s', error %u: %s\n",
+                TEXTURE_ATLAS_PATH, error, lodepng_error_text(error));
+        return -1;
+    }
+    tile_size = (int)width / ATLAS_TILES;
+    for (id = 0; id < 256; id++)
+    {
+        tile = block_tile(id);
+        sum[0] = sum[1] = sum[2] = 0;
+        for (y = 0; y < tile_size; y++)
+        {
+            for (x = 0; x < tile_size; x++)
+            {
+                // row 0 of the atlas is its top, like the GL upload
+                pixel = atlas + 4 * ((tile / ATLAS_TILES * tile_size + y) *
+                                     width +
+                                     tile % ATLAS_TILES * tile_size + x);
+                for (ch = 0; ch < 3; ch++)
+                {
+                    sum[ch] += pixel[ch];
+                }
+            }
+        }
+        for (ch = 0; ch < 3; ch++)
+        {
+            colours[id][ch] = (unsigned char)(sum[ch] /
+                                              (tile_size * tile_size));
+        }
+    }
+    free(atlas);
+    return 0;
+}
+
+/*
+ * Get the modification time of the newest hunk file a level 0 tile reads:
+ * those of its hunk column and of the -x, -z neighbours it takes its edge
+ * slopes from. 0 if there is none.
+ */
+static time_t hunks_mtime(const int* t)
+{
+    char path[PATH_SIZE];
+    struct stat info;
+    time_t newest = 0;
+    int hx;
+    int hy;
+    int hz;
+
+    for (hx = t[0] - 1; hx <= t[0]; hx++)
+    {
+        for (hz = t[1] - 1; hz <= t[1]; hz++)
+        {
+            for (hy = MIN_HY; hy <= MAX_HY; hy++)
+            {
+                hunk_path(path, PATH_SIZE, storage_dir(), hx, hy, hz);
+                if (stat(path, &info) == 0 && info.st_mtime > newest)
+                {
+                    newest = info.st_mtime;
+                }
+            }
+        }
+    }
+    return newest;
+}
+
+/*
+ * Fill a chunk with its saved blocks, or with generated terrain if it was
+ * never saved.
+ *
+ * @fd: file of the chunk's hunk, -1 if there is none.
+ */
+static void load_chunk(int fd, Chunk* chunk, const int* c)
+{
+    unsigned char slot[SLOT_SIZE];
+
+    if (fd >= 0 &&
+        pread(fd, slot, SLOT_SIZE, slot_offset(c[0], c[1], c[2])) ==
+            SLOT_SIZE &&
+        memcmp(slot, SLOT_MAGIC, 4) == 0)
+    {
+        memcpy(chunk->ids, slot + SLOT_HEADER_SIZE, BLOCKS_PER_CHUNK);
+        return;
+    }
+    memset(chunk->ids, BLOCK_AIR, BLOCKS_PER_CHUNK);
+    generate_terrain(chunk);
+}
+
+/*
+ * Find the topmost block of each column of a chunk column, scanning down
+ * from MAP_MAX_Y. Only the columns from @from_x, @from_z on are scanned.
+ *
+ * @fds: hunk files of the hunk column, indexed by hy - MIN_HY.
+ * @ids, @heights: SCAN_SIZE wide, written from column @from_x, @from_z.
+ */
+static void scan_column(const int* fds, Chunk* chunk, int cx, int cz,
+                        int from_x, int from_z, unsigned char* ids,
+                        int* heights)
+{
+    int c[3];
+    int found = 0;
+    int wanted = (CHUNK_SIZE - from_x) * (CHUNK_SIZE - from_z);
+    int idx;
+    int dx;
+    int dy;
+    int dz;
+
+    for (dx = from_x; dx < CHUNK_SIZE; dx++)
+    {
+        for (dz = from_z; dz < CHUNK_SIZE; dz++)
+        {
+            heights[(dz - from_z) * SCAN_SIZE + dx - from_x] = NO_BLOCK;
+        }
+    }
+
+    c[0] = cx;
+    c[2] = cz;
+    for (c[1] = MAX_CY; c[1] >= MIN_CY && found < wanted; c[1]--)
+    {
+        chunk->a[0] = c[0] * CHUNK_SIZE;
+        chunk->a[1] = c[1] * CHUNK_SIZE;
+        chunk->a[2] = c[2] * CHUNK_SIZE;
+        load_chunk(fds[hunk_coord(c[1]) - MIN_HY], chunk, c);
+        for (dx = from_x; dx < CHUNK_SIZE; dx++)
+        {
+            for (dz = from_z; dz < CHUNK_SIZE; dz++)
+            {
+                idx = (dz - from_z) * SCAN_SIZE + dx - from_x;
+                if (heights[idx] != NO_BLOCK)
+                {
+                    continue;
+                }
+                for (dy = CHUNK_SIZE - 1; dy >= 0; dy--)
+                {
+                    if ((chunk->ids)[dx][dy][dz] != BLOCK_AIR)
+                    {
+                        heights[idx] = chunk->a[1] + dy;
+                        ids[idx] = (chunk->ids)[dx][dy][dz];
+                        found++;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // the column is shared by the whole stack, let it go
+    if (chunk->column)
+    {
+        column_release(chunk->column);
+        chunk->column = NULL;
+    }
+}
+
+/*
+ * Colour the pixels of a level 0 tile from its top blocks. @ids and
+ * @heights are SCAN_SIZE square, with the tile from (1, 1) on and the
+ * edge of the -x, -z neighbours in the first column and row.
+ */
+static void shade(const unsigned char* ids, const int* heights,
+                  unsigned char* pixels)
+{
+    unsigned char* pixel;
+    float light;
+    float relief;
+    float value;
+    int height;
+    int slope;
+    int near;
+    int idx;
+    int x;
+    int z;
+    int ch;
+
+    for (z = 0; z < MAP_TILE_SIZE; z++)
+    {
+        for (x = 0; x < MAP_TILE_SIZE; x++)
+        {
+            pixel = pixels + 4 * (z * MAP_TILE_SIZE + x);
+            idx = (z + 1) * SCAN_SIZE + x + 1;
+            if (heights[idx] == NO_BLOCK)
+            {
+                memset(pixel, 0, 4);
+                continue;
+            }
+
+            // higher is brighter, slopes facing -x -z are lit
+            height = heights[idx];
+            light = 0.6f + 0.4f * (height - MAP_MIN_Y) /
+                           (float)(MAP_MAX_Y - MAP_MIN_Y);
+            near = heights[idx - SCAN_SIZE - 1];
+            slope = (near == NO_BLOCK) ? 0 : height - near;
+            relief = 1.0f + MAP_RELIEF * slope;
+            light *= (relief < 0.5f) ? 0.5f : (relief > 1.5f) ? 1.5f : relief;
+            for (ch = 0; ch < 3; ch++)
+            {
+                value = colours[ids[idx]][ch] * light;
+                pixel[ch] = (unsigned char)(value < 0.0f ? 0.0f :
+                                            value > 255.0f ? 255.0f : value);
+            }
+            pixel[3] = 255;
+        }
+    }
+}
+
+/*
+ * Write a tile's pixels to its PNG.
+ */
+static void save_tile(const MapTile* tile)
+{
+    char path[PATH_SIZE];
+    unsigned int error;
+
+    tile_path(path, tile->level, tile->t);
+    error = lodepng_encode32_file(path, tile->pixels, MAP_TILE_SIZE,
+                                  MAP_TILE_SIZE);
+    if (error)
+    {
+        fprintf(stderr, "Could not write '%s', error %u: %s\n", path, error,
+                lodepng_error_text(error));
+    }
+}
+
+static void base_job(void* arg, int canceled)
+{
+    MapTile* tile = arg;
+    char path[PATH_SIZE];
+    int fds[2][2][MAX_HY - MIN_HY + 1]; // [x][z], neighbour hunks first
+    unsigned char* ids;
+    int* heights;
+    Chunk* chunk;
+    int hx;
+    int hy;
+    int hz;
+    int cx;
+    int cz;
+    int from_x;
+    int from_z;
+    int offset;
+
+    if (canceled)
+    {
+        return;
+    }
+    for (hx = 0; hx < 2; hx++)
+    {
+        for (hz = 0; hz < 2; hz++)
+        {
+            for (hy = MIN_HY; hy <= MAX_HY; hy++)
+            {
+                hunk_path(path, PATH_SIZE, storage_dir(),
+                          tile->t[0] - 1 + hx, hy, tile->t[1] - 1 + hz);
+                fds[hx][hz][hy - MIN_HY] = open(path, O_RDONLY);
+            }
+        }
+    }
+    ids = malloc(SCAN_SIZE * SCAN_SIZE);
+    heights = malloc(SCAN_SIZE * SCAN_SIZE * sizeof(int));
+    chunk = construct_chunk(0, 0, 0);
+
+    // the chunk columns at -1 only give their last column/row, for slopes
+    for (cx = -1; cx < HUNK_SIZE; cx++)
+    {
+        for (cz = -1; cz < HUNK_SIZE; cz++)
+        {
+            from_x = (cx < 0) ? CHUNK_SIZE - 1 : 0;
+            from_z = (cz < 0) ? CHUNK_SIZE - 1 : 0;
+            offset = (cz * CHUNK_SIZE + from_z + 1) * SCAN_SIZE +
+                     cx * CHUNK_SIZE + from_x + 1;
+            scan_column(fds[cx >= 0][cz >= 0], chunk,
+                        tile->t[0] * HUNK_SIZE + cx,
+                        tile->t[1] * HUNK_SIZE + cz, from_x, from_z,
+                        ids + offset, heights + offset);
+        }
+    }
+    destroy_chunk(chunk);
+    for (hx = 0; hx < 2; hx++)
+    {
+        for (hz = 0; hz < 2; hz++)
+        {
+            for (hy = MIN_HY; hy <= MAX_HY; hy++)
+            {
+                if (fds[hx][hz][hy - MIN_HY] >= 0)
+                {
+                    close(fds[hx][hz][hy - MIN_HY]);
+                }
+            }
+        }
+    }
+
+    tile->pixels = malloc(TILE_PIXELS * 4);
+    shade(ids, heights, tile->pixels);
+    free(ids);
+    free(heights);
+    save_tile(tile);
+}
+
+/*
+ * Get the pixels of a child tile, from memory if it was rendered this
+ * run, from its PNG otherwise. Returns NULL if it has none.
+ */
+static unsigned char* child_pixels(MapTile* child)
+{
+    char path[PATH_SIZE];
+    unsigned char* pixels;
+    unsigned int width;
+    unsigned int height;
+
+    if (child == NULL)
+    {
+        return NULL;
+    }
+    if (child->pixels)
+    {
+        pixels = child->pixels;
+        child->pixels = NULL;
+        return pixels;
+    }
+    tile_path(path, child->level, child->t);
+    if (lodepng_decode32_file(&pixels, &width, &height, path) != 0)
+    {
+        return NULL;
+    }
+    if (width != MAP_TILE_SIZE || height != MAP_TILE_SIZE)
+    {
+        free(pixels);
+        return NULL;
+    }
+    return pixels;
+}
+
+static void parent_job(void* arg, int canceled)
+{
+    MapTile* tile = arg;
+    const unsigned char* quad[4];
+    unsigned char* pixels;
+    unsigned char* out;
+    unsigned int sum[4];
+    int child;
+    int q;
+    int x;
+    int z;
+    int sx;
+    int sz;
+    int ch;
+
+    if (canceled)
+    {
+        return;
+    }
+    tile->pixels = calloc(TILE_PIXELS, 4);
+    for (child = 0; child < 4; child++)
+    {
+        pixels = child_pixels(tile->children[child]);
+        if (pixels == NULL)
+        {
+            continue;
+        }
+
+        // children are (x, z) = (0, 0), (0, 1), (1, 0), (1, 1)
+        for (z = 0; z < MAP_TILE_SIZE / 2; z++)
+        {
+            for (x = 0; x < MAP_TILE_SIZE / 2; x++)
+            {
+                quad[0] = pixels + 4 * (2 * z * MAP_TILE_SIZE + 2 * x);
+                quad[1] = quad[0] + 4;
+                quad[2] = quad[0] + 4 * MAP_TILE_SIZE;
+                quad[3] = quad[2] + 4;
+                memset(sum, 0, sizeof(sum));
+                for (q = 0; q < 4; q++)
+                {
+                    // weigh colours by alpha, so holes don't darken
+                    for (ch = 0; ch < 3; ch++)
+                    {
+                        sum[ch] += quad[q][ch] * quad[q][3];
+                    }
+                    sum[3] += quad[q][3];
+                }
+                sx = (child / 2) * MAP_TILE_SIZE / 2 + x;
+                sz = (child % 2) * MAP_TILE_SIZE / 2 + z;
+                out = tile->pixels + 4 * (sz * MAP_TILE_SIZE + sx);
+                for (ch = 0; ch < 3 && sum[3] > 0; ch++)
+                {
+                    out[ch] = (unsigned char)(sum[ch] / sum[3]);
+                }
+                out[3] = (unsigned char)(sum[3] / 4);
+            }
+        }
+        free(pixels);
+    }
+    save_tile(tile);
+}
+
+long map_render(const char* dir, const int* min, const int* max)
+{
+    char path[PATH_SIZE];
+    MapLevel levels[MAP_LEVELS];
+    struct stat info;
+    MapLevel* level;
+    MapTile* tile;
+    long rendered = 0;
+    int count;
+    int idx;
+    int lvl;
+    int axis;
+    int child;
+    int tx;
+    int tz;
+
+    snprintf(map_dir, PATH_SIZE, "%s", dir);
+    if (load_colours() != 0)
+    {
+        return -1;
+    }
+    if (mkdir(map_dir, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "mkdir %s failed: %d\n", map_dir, errno);
+        return -1;
+    }
+
+    for (lvl = 0; lvl < MAP_LEVELS; lvl++)
+    {
+        snprintf(path, PATH_SIZE, "%s/%d", map_dir, lvl);
+        if (mkdir(path, 0755) != 0 && errno != EEXIST)
+        {
+            fprintf(stderr, "mkdir %s failed: %d\n", path, errno);
+            return -1;
+        }
+
+        level = &levels[lvl];
+        for (axis = 0; axis < 2; axis++)
+        {
+            level->lo[axis] = floor_div(min[axis] < max[axis] ?
+                                        min[axis] : max[axis],
+                                        MAP_TILE_SIZE << lvl);
+            level->hi[axis] = floor_div(min[axis] < max[axis] ?
+                                        max[axis] : min[axis],
+                                        MAP_TILE_SIZE << lvl);
+        }
+        count = (level->hi[0] - level->lo[0] + 1) *
+                (level->hi[1] - level->lo[1] + 1);
+        level->tiles = calloc(count, sizeof(MapTile));
+
+        for (tx = level->lo[0]; tx <= level->hi[0]; tx++)
+        {
+            for (tz = level->lo[1]; tz <= level->hi[1]; tz++)
+            {
+                tile = level_tile(level, tx, tz);
+                tile->level = lvl;
+                tile->t[0] = tx;
+                tile->t[1] = tz;
+                tile_path(path, lvl, tile->t);
+                if (stat(path, &info) != 0)
+                {
+                    tile->dirty = 1;
+                }
+                else if (lvl == 0)
+                {
+                    tile->dirty = hunks_mtime(tile->t) >= info.st_mtime;
+                }
+
+                for (child = 0; lvl > 0 && child < 4; child++)
+                {
+                    tile->children[child] = level_tile(
+                        &levels[lvl - 1], 2 * tx + child / 2,
+                        2 * tz + child % 2);
+                    if (tile->children[child] &&
+                        tile->children[child]->dirty)
+                    {
+                        tile->dirty = 1;
+                    }
+                }
+                if (!tile->dirty)
+                {
+                    continue;
+                }
+
+                // parents run as soon as they can, to free their children
+                if (lvl == 0)
+                {
+                    tile->job = job_create(base_job, tile,
+                                           JOB_PRIORITY_NORMAL);
+                }
+                else
+                {
+                    tile->job = job_create(parent_job, tile,
+                                           JOB_PRIORITY_HIGH);
+                    for (child = 0; child < 4; child++)
+                    {
+                        if (tile->children[child] &&
+                            tile->children[child]->job)
+                        {
+                            job_depends_on(tile->job,
+                                           tile->children[child]->job);
+                        }
+                    }
+                }
+                job_submit(tile->job);
+                rendered++;
+            }
+        }
+    }
+
+    for (lvl = 0; lvl < MAP_LEVELS; lvl++)
+    {
+        level = &levels[lvl];
+        count = (level->hi[0] - level->lo[0] + 1) *
+                (level->hi[1] - level->lo[1] + 1);
+        for (idx = 0; idx < count; idx++)
+        {
+            if (level->tiles[idx].job)
+            {
+                job_wait(level->tiles[idx].job);
+                job_release(level->tiles[idx].job);
+            }
+        }
+    }
+    for (lvl = 0; lvl < MAP_LEVELS; lvl++)
+    {
+        level = &levels[lvl];
+        count = (level->hi[0] - level->lo[0] + 1) *
+                (level->hi[1] - level->lo[1] + 1);
+        for (idx = 0; idx < count; idx++)
+        {
+            free(level->tiles[idx].pixels); // only the top level's are left
+        }
+        free(level->tiles);
+    }
+    return rendered;
+}
+
+int map_run(const int* min, const int* max)
+{
+    struct timespec start;
+    struct timespec end;
+    long rendered;
+
+    jobs_init(0);
+    if (storage_init(WORLD_DIR) != 0)
+    {
+        fprintf(stderr, "Could not set up world storage.\n");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    rendered = map_render(MAP_DIR, min, max);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    jobs_shutdown();
+    storage_shutdown();
+    if (rendered < 0)
+    {
+        return 1;
+    }
+    printf("Rendered %ld map tiles into %s in %.2f s.\n", rendered, MAP_DIR,
+           (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9);
+    return 0;
+}
@@ -0,0 +1,60 @@
+/*
+ * Offline overview maps: a top-down tile pyramid of the world rendered to
+ * PNGs, for looking at worlds without the 3D client.
+ *
+ * Level 0 has one pixel per block column. Its tiles are MAP_TILE_SIZE
+ * pixels square, exactly one hunk column (see storage.h), so each of them
+ * reads its own set of hunk files, plus the edge of its -x and -z
+ * neighbours for the slopes of its first column and row. Every further
+ * level halves the resolution, up to MAP_LEVELS levels. Tiles are written
+ * to MAP_DIR/<level>/tile.<tx>.<tz>.png, with image x along block x and
+ * image y along block z. Tile (tx, tz) of level L covers the level 0
+ * tiles (tx * 2^L, tz * 2^L) through ((tx + 1) * 2^L - 1, ...).
+ *
+ * A pixel shows the topmost block of its column. The colour is the mean
+ * colour of the block's atlas tile (see block_tile()), lit by the height
+ * of the column and by its slope towards its neighbours. Columns with no
+ * block between MAP_MIN_Y and MAP_MAX_Y are transparent. Chunks come from
+ * the world's hunk files, or from the terrain generator if they were
+ * never saved.
+ *
+ * Tiles are rendered as jobs. A tile of a higher level is a job that
+ * depends on the jobs of its four children and is downsampled from their
+ * pixels, so the whole pyramid renders in one pass on all cores.
+ *
+ * Rendering is incremental. A level 0 tile is only rendered again if its
+ * PNG is missing or older than one of the hunk files it reads. A higher
+ * tile is only rendered again if one of its children was, or if it is
+ * missing. After changing the terrain generator or the atlas, delete
+ * MAP_DIR.
+ */
+
+#ifndef MAP_H
+#define MAP_H
+
+#define MAP_DIR "map"
+#define MAP_TILE_SIZE 256 // pixels, one hunk column at level 0
+#define MAP_LEVELS 6
+#define MAP_MIN_Y -64 // lowest block looked at
+#define MAP_MAX_Y 127 // highest block looked at
+#define MAP_RELIEF 0.15f // brightness change per block of slope
+
+/*
+ * Render the tiles of every level that cover a box of block columns into
+ * @dir. Returns the number of tiles rendered, -1 on error. Jobs and
+ * storage must be set up.
+ *
+ * @min, @max: opposite corners of the box (x, z), inclusive.
+ */
+long map_render(const char* dir, const int* min, const int* max);
+
+/*
+ * Run the map renderer as the whole program: render the map of a box of
+ * block columns of WORLD_DIR into MAP_DIR and report how long it took.
+ * Returns the exit status.
+ *
+ * @min, @max: opposite corners of the box (x, z), inclusive.
+ */
+int map_run(const int* min, const int* max);
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ * Implementation of baked chunk meshes.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "mesh.h"
+
+#define MIN_MESH_VTXS (VTXS_PER_BLOCK * 16)
+
+#define COPY_VERTEX(v, vertices);            \
+    vertices[0] = v[0];                      \
+    vertices[1] = v[1];                      \
+    vertices[2] = v[2];                      \
+    vertices = vertices + 3;
+
+#define COPY_TEXCOORD(t, texcoords); \
+    texcoords[0] = t[0];             \
+    texcoords[1] = t[1];             \
+    texcoords = texcoords + 2;
+
+/*
+ * Index of each DIR_*'s face in the output of comp_block_vertex_data().
+ */
+static const int face_of_dir[DIR_COUNT] = {0, 2, 1, 3, 4, 5};
+
+void comp_block_vertex_data(const int* a, float* vertex_data)
+{
+    // TODO use VBO indexing
+    // see project notebook p.9 for drawings. Transfer in when finalized.
+
+    const int b[3] = {a[0]+1, a[1]  , a[2]  };
+    const int c[3] = {a[0]  , a[1]  , a[2]-1};
+    const int d[3] = {a[0]+1, a[1]  , a[2]-1};
+    const int e[3] = {a[0]  , a[1]-1, a[2]  };
+    const int f[3] = {a[0]+1, a[1]-1, a[2]  };
+    const int g[3] = {a[0]  , a[1]-1, a[2]-1};
+    const int h[3] = {a[0]+1, a[1]-1, a[2]-1};
+
+    // face 1
+    COPY_VERTEX(b, vertex_data); // b-a-f
+    COPY_VERTEX(a, vertex_data);
+    COPY_VERTEX(f, vertex_data);
+    COPY_VERTEX(e, vertex_data); // e-f-a
+    COPY_VERTEX(f, vertex_data);
+    COPY_VERTEX(a, vertex_data);
+    // face 2
+    COPY_VERTEX(a, vertex_data); // a-c-e
+    COPY_VERTEX(c, vertex_data);
+    COPY_VERTEX(e, vertex_data);
+    COPY_VERTEX(g, vertex_data); // g-e-c
+    COPY_VERTEX(e, vertex_data);
+    COPY_VERTEX(c, vertex_data);
+    // face 3
+    COPY_VERTEX(c, vertex_data); // c-d-g
+    COPY_VERTEX(d, vertex_data);
+    COPY_VERTEX(g, vertex_data);
+    COPY_VERTEX(h, vertex_data); // h-g-d
+    COPY_VERTEX(g, vertex_data);
+    COPY_VERTEX(d, vertex_data);
+    // face 4
+    COPY_VERTEX(d, vertex_data); // d-b-h
+    COPY_VERTEX(b, vertex_data);
+    COPY_VERTEX(h, vertex_data);
+    COPY_VERTEX(f, vertex_data); // f-h-b
+    COPY_VERTEX(h, vertex_data);
+    COPY_VERTEX(b, vertex_data);
+    // face 5
+    COPY_VERTEX(a, vertex_data); // a-b-c
+    COPY_VERTEX(b, vertex_data);
+    COPY_VERTEX(c, vertex_data);
+    COPY_VERTEX(d, vertex_data); // d-c-b
+    COPY_VERTEX(c, vertex_data);
+    COPY_VERTEX(b, vertex_data);
+    // face 6
+    COPY_VERTEX(e, vertex_data); // e-f-g
+    COPY_VERTEX(f, vertex_data);
+    COPY_VERTEX(g, vertex_data);
+    COPY_VERTEX(g, vertex_data); // g-h-f
+    COPY_VERTEX(h, vertex_data);
+    COPY_VERTEX(f, vertex_data);
+}
+
+void comp_block_texture_data(float* texture_data)
+{
+    // see projects notebook p.9 for drawings. Transfer in when finalized.
+    const float a[2] = {0.0f, 0.8750f}; // topleft
+    const float b[2] = {0.0625f, 0.8750f}; // topright
+    const float c[2] = {0.0f, 0.9375f}; // bottomleft
+    const float d[2] = {0.0625f, 0.9375f}; // bottomright
+
+    COPY_TEXCOORD(a, texture_data);
+    COPY_TEXCOORD(b, texture_data);
+    COPY_TEXCOORD(c, texture_data);
+    COPY_TEXCOORD(d, texture_data);
+    COPY_TEXCOORD(c, texture_data);
+    COPY_TEXCOORD(b, texture_data);
+
+    COPY_TEXCOORD(a, texture_data);
+    COPY_TEXCOORD(b, texture_data);
+    COPY_TEXCOORD(c, texture_data);
+    COPY_TEXCOORD(d, texture_data);
+    COPY_TEXCOORD(c, texture_data);
+    COPY_TEXCOORD(b, texture_data);
+
+    COPY_TEXCOORD(a, texture_data);
+    COPY_TEXCOORD(b, texture_data);
+    COPY_TEXCOORD(c, texture_data);
+    COPY_TEXCOORD(d, texture_data);
+    COPY_TEXCOORD(c, texture_data);
+    COPY_TEXCOORD(b, texture_data);
+
+    COPY_TEXCOORD(a, texture_data);
+    COPY_TEXCOORD(b, texture_data);
+    COPY_TEXCOORD(c, texture_data);
+    COPY_TEXCOORD(d, texture_data);
+    COPY_TEXCOORD(c, texture_data);
+    COPY_TEXCOORD(b, texture_data);
+
+    COPY_TEXCOORD(a, texture_data);
+    COPY_TEXCOORD(b, texture_data);
+    COPY_TEXCOORD(c, texture_data);
+    COPY_TEXCOORD(d, texture_data);
+    COPY_TEXCOORD(c, texture_data);
+    COPY_TEXCOORD(b, texture_data);
+
+    COPY_TEXCOORD(a, texture_data);
+    COPY_TEXCOORD(b, texture_data);
+    COPY_TEXCOORD(c, texture_data);
+    COPY_TEXCOORD(d, texture_data);
+    COPY_TEXCOORD(c, texture_data);
+    COPY_TEXCOORD(b, texture_data);
+}
+
+Mesh* build_mesh(const Chunk* chunk)
+{
+    GLfloat vertices[VTXS_PER_BLOCK * 3];
+    GLfloat texcoords[VTXS_PER_BLOCK * 2];
+    unsigned long long exposed[DIR_COUNT];
+    unsigned long long blocks;
+    Mesh* new_mesh;
+    int a[3];
+    int face;
+    int dir;
+    int bit;
+    int x_idx;
+    int word;
+
+    new_mesh = malloc(sizeof(Mesh));
+    new_mesh->vertices = NULL;
+    new_mesh->texcoords = NULL;
+    new_mesh->capacity = 0;
+    new_mesh->vertex_count = 0;
+    new_mesh->mapping = NULL;
+    new_mesh->mapping_size = 0;
+    new_mesh->vertex_array_id = 0;
+    new_mesh->vertex_buffer_id = 0;
+    new_mesh->texcoord_buffer_id = 0;
+    if (chunk->flags & CHUNK_ALL_AIR)
+    {
+        return new_mesh; // nothing to draw
+    }
+
+    new_mesh->capacity = MIN_MESH_VTXS;
+    new_mesh->vertices = malloc(new_mesh->capacity * 3 * sizeof(GLfloat));
+    new_mesh->texcoords = malloc(new_mesh->capacity * 2 * sizeof(GLfloat));
+
+    // visit only the blocks with an exposed face, 64 at a time
+    comp_block_texture_data(texcoords);
+    for (x_idx = 0; x_idx < CHUNK_SIZE; x_idx++)
+    {
+        for (word = 0; word < SOLID_WORDS; word++)
+        {
+            chunk_exposed_faces(chunk, x_idx, word, exposed);
+            blocks = 0;
+            for (dir = 0; dir < DIR_COUNT; dir++)
+            {
+                blocks |= exposed[dir];
+            }
+
+            for (; blocks != 0; blocks &= blocks - 1)
+            {
+                bit = __builtin_ctzll(blocks);
+                a[0] = chunk->a[0] + x_idx;
+                a[1] = chunk->a[1] + word * SOLID_ROWS_PER_WORD +
+                       bit / CHUNK_SIZE;
+                a[2] = chunk->a[2] + bit % CHUNK_SIZE;
+                comp_block_vertex_data(a, vertices);
+
+                for (dir = 0; dir < DIR_COUNT; dir++)
+                {
+                    if (!((exposed[dir] >> bit) & 1))
+                    {
+                        continue; // hidden by a neighbour
+                    }
+                    if (new_mesh->vertex_count + VTXS_PER_FACE >
+                        new_mesh->capacity)
+                    {
+                        new_mesh->capacity *= 2;
+                        new_mesh->vertices = realloc(new_mesh->vertices,
+                            new_mesh->capacity * 3 * sizeof(GLfloat));
+                        new_mesh->texcoords = realloc(new_mesh->texcoords,
+                            new_mesh->capacity * 2 * sizeof(GLfloat));
+                    }
+                    face = face_of_dir[dir];
+                    memcpy(new_mesh->vertices + new_mesh->vertex_count * 3,
+                           vertices + face * VTXS_PER_FACE * 3,
+                           VTXS_PER_FACE * 3 * sizeof(GLfloat));
+                    memcpy(new_mesh->texcoords + new_mesh->vertex_count * 2,
+                           texcoords + face * VTXS_PER_FACE * 2,
+                           VTXS_PER_FACE * 2 * sizeof(GLfloat));
+                    new_mesh->vertex_count += VTXS_PER_FACE;
+                }
+            }
+        }
+    }
+
+    return new_mesh;
+}
+
+void mesh_upload(Mesh* mesh, GLint position_attrib_idx,
+                 GLint texcoord_attrib_idx)
+{
+    if (mesh->vertex_count == 0)
+    {
+        return; // empty chunk, no buffers needed
+    }
+
+    glGenVertexArrays(1, &mesh->vertex_array_id);
+    glBindVertexArray(mesh->vertex_array_id);
+
+    // buffer vertex data into VBO
+    glGenBuffers(1, &mesh->vertex_buffer_id);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vertex_buffer_id);
+    glBufferData(GL_ARRAY_BUFFER, mesh->vertex_count * 3 * sizeof(GLfloat),
+                 mesh->vertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(position_attrib_idx, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+    // buffer texture coordinate data
+    glGenBuffers(1, &mesh->texcoord_buffer_id);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->texcoord_buffer_id);
+    glBufferData(GL_ARRAY_BUFFER, mesh->vertex_count * 2 * sizeof(GLfloat),
+                 mesh->texcoords, GL_STATIC_DRAW);
+    glVertexAttribPointer(texcoord_attrib_idx, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+    glEnableVertexAttribArray(position_attrib_idx);
+    glEnableVertexAttribArray(texcoord_attrib_idx);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void mesh_draw(const Mesh* mesh)
+{
+    if (mesh->vertex_array_id == 0 || mesh->vertex_count == 0)
+    {
+        return;
+    }
+    glBindVertexArray(mesh->vertex_array_id);
+    glDrawArrays(GL_TRIANGLES, 0, mesh->vertex_count);
+    glBindVertexArray(0);
+}
+
+void mesh_unload(Mesh* mesh)
+{
+    if (mesh->vertex_array_id != 0)
+    {
+        glDeleteBuffers(1, &mesh->vertex_buffer_id);
+        glDeleteBuffers(1, &mesh->texcoord_buffer_id);
+        glDeleteVertexArrays(1, &mesh->vertex_array_id);
+        mesh->vertex_array_id = 0;
+        mesh->vertex_buffer_id = 0;
+        mesh->texcoord_buffer_id = 0;
+    }
+}
+
+/*
+ * Free the vertex streams, or unmap them if they came from the mesh cache.
+ */
+static void release_streams(Mesh* mesh)
+{
+    if (mesh->mapping)
+    {
+        munmap(mesh->mapping, mesh->mapping_size);
+        mesh->mapping = NULL;
+        mesh->mapping_size = 0;
+    }
+    else
+    {
+        free(mesh->vertices);
+        free(mesh->texcoords);
+    }
+}
+
+void mesh_drop_cpu(Mesh* mesh)
+{
+    release_streams(mesh);
+    mesh->vertices = NULL;
+    mesh->texcoords = NULL;
+    mesh->capacity = 0;
+}
+
+void destroy_mesh(Mesh* mesh)
+{
+    mesh_unload(mesh);
+    release_streams(mesh);
+    free(mesh);
+}
@@ -0,0 +1,92 @@
+/*
+ * Baked chunk meshes: the vertex streams of every exposed block face of a
+ * chunk, drawn with one glDrawArrays call.
+ *
+ * Meshes are built on the CPU by build_mesh(), which is safe to call from a
+ * job, and handed to GL by mesh_upload() on the main thread. The CPU copy
+ * is kept after upload. Meshes read back from the mesh cache (see
+ * meshcache.h) keep their vertex streams in a read-only file mapping.
+ */
+
+#ifndef MESH_H
+#define MESH_H
+
+#include <GL/glew.h>
+
+#include "chunk.h"
+
+// 12 triangles, 3 vtxs each -> 36 vtxs
+#define VTXS_PER_BLOCK 36
+#define VTXS_PER_FACE 6
+#define MESHER_VERSION 1 // bump whenever build_mesh() output changes
+
+typedef struct MeshTag
+{
+    GLfloat* vertices; // 3 floats per vertex, NULL once dropped
+    GLfloat* texcoords; // 2 floats per vertex, NULL once dropped
+    int vertex_count;
+    int capacity; // vertices allocated
+    void* mapping; // file mapping holding the streams, NULL if malloc'd
+    long mapping_size;
+    GLuint vertex_array_id; // 0 until uploaded
+    GLuint vertex_buffer_id;
+    GLuint texcoord_buffer_id;
+} Mesh;
+
+/*
+ * Compute the vertices for the triangles of a block.
+ *
+ * Faces are written in the order north, east, south, west, up, down, 6
+ * vertices each.
+ *
+ * @a: array of 3 ints, position of vertex of the block most in the
+ *   z- direction, the y+ direction, and x- direction. Its the topmost,
+ *   northwest vtx of the block.
+ * @vertex_data: array of 108 floats. Will contain triangle vertices.
+ */
+void comp_block_vertex_data(const int* a, float* vertex_data);
+
+/*
+ * Compute the texcoords for a voxel.
+ *
+ * @texture_data: array of 72 floats (36 texcoords). Will contain texcoords.
+ */
+void comp_block_texture_data(float* texture_data);
+
+/*
+ * Build the mesh of a chunk. Only faces next to air are kept. Does not
+ * touch GL.
+ */
+Mesh* build_mesh(const Chunk* chunk);
+
+/*
+ * Create the GL objects of a mesh and upload its vertex streams.
+ *
+ * @position_attrib_idx, @texcoord_attrib_idx: attribute locations of the
+ *   block shaders.
+ */
+void mesh_upload(Mesh* mesh, GLint position_attrib_idx,
+                 GLint texcoord_attrib_idx);
+
+/*
+ * Draw an uploaded mesh. The block program must be in use.
+ */
+void mesh_draw(const Mesh* mesh);
+
+/*
+ * Delete the GL objects of a mesh, keeping its vertex streams so it can be
+ * uploaded again.
+ */
+void mesh_unload(Mesh* mesh);
+
+/*
+ * Free the vertex streams of a mesh, keeping its GL objects.
+ */
+void mesh_drop_cpu(Mesh* mesh);
+
+/*
+ * Free a mesh and its GL objects, if any.
+ */
+void destroy_mesh(Mesh* mesh);
+
+#endif
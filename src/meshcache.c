@@ -0,0 +1,398 @@
+/*
+ * Implementation of the mesh cache.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "meshcache.h"
+
+#define MESH_MAGIC "VXM1"
+#define PATH_SIZE 256
+#define NAME_SIZE 24 // <key>.msh
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+typedef struct MeshHeaderTag
+{
+    char magic[4];
+    unsigned int version;
+    unsigned long long key;
+    unsigned int vertex_count;
+    unsigned int padding;
+} MeshHeader;
+
+/*
+ * A cache file, as found when trimming the cache.
+ */
+typedef struct EntryTag
+{
+    char name[NAME_SIZE];
+    time_t used; // modification time
+    long size;
+} Entry;
+
+static char cache_dir[PATH_SIZE];
+static int enabled = 0;
+static long hits = 0;
+static long misses = 0;
+static long stores = 0;
+static long evictions = 0;
+static long next_temp = 0; // makes temporary file names unique
+static long cache_bytes = 0; // size of all entries, as last counted
+static int trimming = 0; // a thread is trimming the cache
+
+static unsigned long long rotl(unsigned long long x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static unsigned long long read64(const unsigned char* p)
+{
+    unsigned long long v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned int read32(const unsigned char* p)
+{
+    unsigned int v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned long long xxh_round(unsigned long long acc,
+                                    unsigned long long input)
+{
+    acc += input * PRIME64_2;
+    acc = rotl(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static unsigned long long xxh_merge(unsigned long long acc,
+                                    unsigned long long val)
+{
+    acc ^= xxh_round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+unsigned long long xxh64(const void* data, size_t size,
+                         unsigned long long seed)
+{
+    const unsigned char* p = data;
+    const unsigned char* end = p + size;
+    unsigned long long v[4];
+    unsigned long long h;
+
+    if (size >= 32)
+    {
+        v[0] = seed + PRIME64_1 + PRIME64_2;
+        v[1] = seed + PRIME64_2;
+        v[2] = seed;
+        v[3] = seed - PRIME64_1;
+        for (; p + 32 <= end; p += 32)
+        {
+            v[0] = xxh_round(v[0], read64(p));
+            v[1] = xxh_round(v[1], read64(p + 8));
+            v[2] = xxh_round(v[2], read64(p + 16));
+            v[3] = xxh_round(v[3], read64(p + 24));
+        }
+        h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+        h = xxh_merge(h, v[0]);
+        h = xxh_merge(h, v[1]);
+        h = xxh_merge(h, v[2]);
+        h = xxh_merge(h, v[3]);
+    }
+    else
+    {
+        h = seed + PRIME64_5;
+    }
+    h += (unsigned long long)size;
+
+    for (; p + 8 <= end; p += 8)
+    {
+        h ^= xxh_round(0, read64(p));
+        h = rotl(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (p + 4 <= end)
+    {
+        h ^= (unsigned long long)read32(p) * PRIME64_1;
+        h = rotl(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; p++)
+    {
+        h ^= (*p) * PRIME64_5;
+        h = rotl(h, 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static void entry_path(char* path, unsigned long long key)
+{
+    snprintf(path, PATH_SIZE, "%s/%016llx.msh", cache_dir, key);
+}
+
+static int compare_entries(const void* a, const void* b)
+{
+    time_t x = ((const Entry*)a)->used;
+    time_t y = ((const Entry*)b)->used;
+    return (x > y) - (x < y);
+}
+
+/*
+ * List the entries of the cache directory. Returns their number, -1 on
+ * error. The caller frees *@entries.
+ *
+ * @total: set to the size of all entries.
+ */
+static int list_entries(Entry** entries, long* total)
+{
+    char path[PATH_SIZE];
+    struct dirent* item;
+    struct stat info;
+    DIR* dir;
+    size_t length;
+    int capacity = 0;
+    int count = 0;
+
+    dir = opendir(cache_dir);
+    if (dir == NULL)
+    {
+        return -1;
+    }
+    *entries = NULL;
+    *total = 0;
+    while ((item = readdir(dir)) != NULL)
+    {
+        length = strlen(item->d_name);
+        if (length >= NAME_SIZE || length < 4 ||
+            strcmp(item->d_name + length - 4, ".msh") != 0)
+        {
+            continue; // not an entry, or a file being written
+        }
+        snprintf(path, PATH_SIZE, "%s/%s", cache_dir, item->d_name);
+        if (stat(path, &info) != 0)
+        {
+            continue; // deleted meanwhile
+        }
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            *entries = realloc(*entries, capacity * sizeof(Entry));
+        }
+        memcpy((*entries)[count].name, item->d_name, length + 1);
+        (*entries)[count].used = info.st_mtime;
+        (*entries)[count].size = info.st_size;
+        *total += info.st_size;
+        count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+/*
+ * Delete the least recently used entries until MESH_CACHE_LOW_BYTES are
+ * left. Only one thread trims at a time, the others go on storing.
+ */
+static void trim()
+{
+    char path[PATH_SIZE];
+    Entry* entries;
+    long total;
+    int count;
+    int idx;
+
+    if (__atomic_exchange_n(&trimming, 1, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+    count = list_entries(&entries, &total);
+    if (count >= 0)
+    {
+        qsort(entries, count, sizeof(Entry), compare_entries);
+        for (idx = 0; idx < count && total > MESH_CACHE_LOW_BYTES; idx++)
+        {
+            snprintf(path, PATH_SIZE, "%s/%s", cache_dir, entries[idx].name);
+            if (unlink(path) == 0)
+            {
+                total -= entries[idx].size;
+                __atomic_add_fetch(&evictions, 1, __ATOMIC_RELAXED);
+            }
+        }
+        free(entries);
+        // stores made during the scan may be missed, the next trim recounts
+        __atomic_store_n(&cache_bytes, total, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&trimming, 0, __ATOMIC_RELEASE);
+}
+
+int mesh_cache_init(const char* dir)
+{
+    Entry* entries;
+    long total;
+    int count;
+
+    snprintf(cache_dir, PATH_SIZE, "%s", dir);
+    if (mkdir(cache_dir, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "mkdir %s failed: %d\n", cache_dir, errno);
+        return -1;
+    }
+    count = list_entries(&entries, &total);
+    if (count >= 0)
+    {
+        free(entries);
+        cache_bytes = total;
+    }
+    enabled = 1;
+    if (cache_bytes > MESH_CACHE_MAX_BYTES)
+    {
+        trim();
+    }
+    return 0;
+}
+
+unsigned long long mesh_cache_key(const Chunk* chunk)
+{
+    unsigned long long seed;
+
+    seed = xxh64(chunk->a, sizeof(chunk->a), MESHER_VERSION);
+    return xxh64(chunk->ids, BLOCKS_PER_CHUNK, seed);
+}
+
+Mesh* mesh_cache_load(const Chunk* chunk)
+{
+    char path[PATH_SIZE];
+    struct stat info;
+    MeshHeader header;
+    Mesh* mesh;
+    unsigned char* map;
+    unsigned long long key;
+    int fd;
+
+    if (!enabled || (chunk->flags & CHUNK_ALL_AIR))
+    {
+        return NULL; // empty meshes are quicker to build
+    }
+    key = mesh_cache_key(chunk);
+    entry_path(path, key);
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        __atomic_add_fetch(&misses, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(header))
+    {
+        close(fd);
+        __atomic_add_fetch(&misses, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    futimens(fd, NULL); // recently used, see trim()
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        __atomic_add_fetch(&misses, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    memcpy(&header, map, sizeof(header));
+    if (memcmp(header.magic, MESH_MAGIC, 4) != 0 ||
+        header.version != MESHER_VERSION || header.key != key ||
+        info.st_size != (off_t)(sizeof(header) +
+                                header.vertex_count * 5 * sizeof(GLfloat)))
+    {
+        munmap(map, info.st_size);
+        __atomic_add_fetch(&misses, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    mesh = malloc(sizeof(Mesh));
+    mesh->vertices = (GLfloat*)(map + sizeof(header));
+    mesh->texcoords = mesh->vertices + header.vertex_count * 3;
+    mesh->vertex_count = header.vertex_count;
+    mesh->capacity = header.vertex_count;
+    mesh->mapping = map;
+    mesh->mapping_size = info.st_size;
+    mesh->vertex_array_id = 0;
+    mesh->vertex_buffer_id = 0;
+    mesh->texcoord_buffer_id = 0;
+    __atomic_add_fetch(&hits, 1, __ATOMIC_RELAXED);
+    return mesh;
+}
+
+void mesh_cache_store(const Chunk* chunk, const Mesh* mesh)
+{
+    char path[PATH_SIZE];
+    char temp[PATH_SIZE];
+    MeshHeader header;
+    FILE* file;
+    int ok;
+
+    if (!enabled || mesh->vertex_count == 0)
+    {
+        return;
+    }
+    memcpy(header.magic, MESH_MAGIC, 4);
+    header.version = MESHER_VERSION;
+    header.key = mesh_cache_key(chunk);
+    header.vertex_count = mesh->vertex_count;
+    header.padding = 0;
+
+    entry_path(path, header.key);
+    snprintf(temp, PATH_SIZE, "%s/%ld.tmp", cache_dir,
+             __atomic_fetch_add(&next_temp, 1, __ATOMIC_RELAXED));
+    file = fopen(temp, "wb");
+    if (file == NULL)
+    {
+        return;
+    }
+    ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+         fwrite(mesh->vertices, 3 * sizeof(GLfloat), mesh->vertex_count,
+                file) == (size_t)mesh->vertex_count &&
+         fwrite(mesh->texcoords, 2 * sizeof(GLfloat), mesh->vertex_count,
+                file) == (size_t)mesh->vertex_count;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(temp, path) != 0)
+    {
+        unlink(temp);
+        return;
+    }
+    __atomic_add_fetch(&stores, 1, __ATOMIC_RELAXED);
+    if (__atomic_add_fetch(&cache_bytes, (long)(sizeof(header) +
+                           mesh->vertex_count * 5 * sizeof(GLfloat)),
+                           __ATOMIC_RELAXED) > MESH_CACHE_MAX_BYTES)
+    {
+        trim();
+    }
+}
+
+void mesh_cache_print(FILE* file)
+{
+    fprintf(file, "mesh cache: %ld hits, %ld misses, %ld stored, "
+            "%ld evicted\n",
+            __atomic_load_n(&hits, __ATOMIC_RELAXED),
+            __atomic_load_n(&misses, __ATOMIC_RELAXED),
+            __atomic_load_n(&stores, __ATOMIC_RELAXED),
+            __atomic_load_n(&evictions, __ATOMIC_RELAXED));
+}
@@ -0,0 +1,70 @@
+/*
+ * On-disk cache of baked chunk meshes, so reopening a world does not mesh
+ * every chunk again.
+ *
+ * A mesh is stored under a 64-bit XXH64 hash of everything build_mesh()
+ * reads: the chunk's block ids, its coordinates (vertices are in world
+ * space), and MESHER_VERSION. The mesher treats blocks outside the chunk
+ * as air, so neighbours are not part of the key. A chunk whose key is
+ * cached gets its mesh memory-mapped from the file and uploaded straight
+ * from the mapping, without meshing.
+ *
+ * Each mesh is one file, MESH_CACHE_DIR/<key>.msh:
+ *   "VXM1", MESHER_VERSION (uint32), key (uint64), vertex count (uint32),
+ *   4 bytes padding, the vertex positions (3 floats each), then the
+ *   texcoords (2 floats each). Native byte order.
+ *
+ * Files are written under a temporary name and renamed, so readers never
+ * see half a file. Loading an entry bumps its modification time. When the
+ * entries add up to more than MESH_CACHE_MAX_BYTES, the least recently
+ * used ones are deleted until MESH_CACHE_LOW_BYTES are left. Deleting the
+ * directory is always safe.
+ *
+ * Safe to use from any thread.
+ */
+
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <stdio.h>
+
+#include "chunk.h"
+#include "mesh.h"
+
+#define MESH_CACHE_DIR "meshes"
+#define MESH_CACHE_MAX_BYTES (256L << 20)
+#define MESH_CACHE_LOW_BYTES (192L << 20) // left after trimming
+
+/*
+ * Use @dir for the cache, creating it if needed. Returns 0 on success.
+ * Without it, the cache does nothing.
+ */
+int mesh_cache_init(const char* dir);
+
+/*
+ * Get the cache key of a chunk's mesh.
+ */
+unsigned long long mesh_cache_key(const Chunk* chunk);
+
+/*
+ * Get a chunk's mesh from the cache. Returns NULL if it is not cached.
+ */
+Mesh* mesh_cache_load(const Chunk* chunk);
+
+/*
+ * Store a chunk's freshly built mesh. Empty meshes are not stored.
+ */
+void mesh_cache_store(const Chunk* chunk, const Mesh* mesh);
+
+/*
+ * Print the hits, misses, stores and evictions since start on one line.
+ */
+void mesh_cache_print(FILE* file);
+
+/*
+ * XXH64 hash of @size bytes at @data.
+ */
+unsigned long long xxh64(const void* data, size_t size,
+                         unsigned long long seed);
+
+#endif
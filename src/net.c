@@ -0,0 +1,315 @@
+/*
+ * Implementation of connections and message framing.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "net.h"
+
+#define UNIX_PREFIX "unix:"
+#define MIN_BUFFER 4096
+#define LISTEN_BACKLOG 8
+
+static void set_nonblocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+/*
+ * Open a socket for @address and bind (@server) or connect it to it.
+ */
+static int open_socket(const char* address, int server)
+{
+    struct sockaddr_un un;
+    struct addrinfo hints;
+    struct addrinfo* found;
+    struct addrinfo* info;
+    char host[256];
+    const char* colon;
+    int fd = -1;
+    int one = 1;
+
+    if (strncmp(address, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0)
+    {
+        memset(&un, 0, sizeof(un));
+        un.sun_family = AF_UNIX;
+        snprintf(un.sun_path, sizeof(un.sun_path), "%s",
+                 address + strlen(UNIX_PREFIX));
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        if (server)
+        {
+            unlink(un.sun_path); // left over from a previous run
+        }
+        if ((server ? bind(fd, (struct sockaddr*)&un, sizeof(un))
+                    : connect(fd, (struct sockaddr*)&un, sizeof(un))) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    colon = strrchr(address, ':');
+    if (colon == NULL || colon - address >= (int)sizeof(host))
+    {
+        fprintf(stderr, "Bad address '%s'.\n", address);
+        return -1;
+    }
+    memcpy(host, address, colon - address);
+    host[colon - address] = '\0';
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = server ? AI_PASSIVE : 0;
+    if (getaddrinfo(host[0] ? host : NULL, colon + 1, &hints, &found) != 0)
+    {
+        fprintf(stderr, "Could not resolve '%s'.\n", address);
+        return -1;
+    }
+    for (info = found; info != NULL; info = info->ai_next)
+    {
+        fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+        if (fd < 0)
+        {
+            continue;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if ((server ? bind(fd, info->ai_addr, info->ai_addrlen)
+                    : connect(fd, info->ai_addr, info->ai_addrlen)) == 0)
+        {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(found);
+    return fd;
+}
+
+int net_listen(const char* address)
+{
+    int fd = open_socket(address, 1);
+
+    if (fd < 0 || listen(fd, LISTEN_BACKLOG) != 0)
+    {
+        fprintf(stderr, "Could not listen on '%s': %d\n", address, errno);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    set_nonblocking(fd);
+    return fd;
+}
+
+int net_accept(int fd)
+{
+    int client = accept(fd, NULL, NULL);
+
+    if (client >= 0)
+    {
+        set_nonblocking(client);
+    }
+    return client;
+}
+
+int net_connect(const char* address)
+{
+    int fd = open_socket(address, 0);
+
+    if (fd < 0)
+    {
+        fprintf(stderr, "Could not connect to '%s': %d\n", address, errno);
+        return -1;
+    }
+    set_nonblocking(fd);
+    return fd;
+}
+
+Connection* construct_connection(int fd)
+{
+    Connection* connection = malloc(sizeof(Connection));
+
+    connection->fd = fd;
+    connection->in_capacity = MIN_BUFFER;
+    connection->in = malloc(connection->in_capacity);
+    connection->in_start = 0;
+    connection->in_size = 0;
+    connection->out_capacity = MIN_BUFFER;
+    connection->out = malloc(connection->out_capacity);
+    connection->out_size = 0;
+    return connection;
+}
+
+void destroy_connection(Connection* connection)
+{
+    close(connection->fd);
+    free(connection->in);
+    free(connection->out);
+    free(connection);
+}
+
+void net_send(Connection* connection, int type, const unsigned char* payload,
+              int size)
+{
+    unsigned char* at;
+
+    while (connection->out_size + MSG_HEADER_SIZE + size >
+           connection->out_capacity)
+    {
+        connection->out_capacity *= 2;
+        connection->out = realloc(connection->out, connection->out_capacity);
+    }
+    at = connection->out + connection->out_size;
+    at[0] = (unsigned char)type;
+    put_u32(at + 1, (unsigned int)size);
+    memcpy(at + MSG_HEADER_SIZE, payload, size);
+    connection->out_size += MSG_HEADER_SIZE + size;
+}
+
+int net_flush(Connection* connection)
+{
+    ssize_t sent;
+    int done = 0;
+
+    while (done < connection->out_size)
+    {
+        sent = send(connection->fd, connection->out + done,
+                    connection->out_size - done, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            return -1;
+        }
+        done += (int)sent;
+    }
+    memmove(connection->out, connection->out + done,
+            connection->out_size - done);
+    connection->out_size -= done;
+    return 0;
+}
+
+int net_receive(Connection* connection)
+{
+    ssize_t got;
+
+    // drop handled bytes so the buffer only grows for large messages
+    if (connection->in_start > 0)
+    {
+        memmove(connection->in, connection->in + connection->in_start,
+                connection->in_size - connection->in_start);
+        connection->in_size -= connection->in_start;
+        connection->in_start = 0;
+    }
+
+    // stop at NET_MAX_INPUT, the rest stays in the socket for next time
+    while (connection->in_size < NET_MAX_INPUT)
+    {
+        if (connection->in_size == connection->in_capacity)
+        {
+            connection->in_capacity *= 2;
+            if (connection->in_capacity > NET_MAX_INPUT)
+            {
+                connection->in_capacity = NET_MAX_INPUT;
+            }
+            connection->in = realloc(connection->in, connection->in_capacity);
+        }
+        got = recv(connection->fd, connection->in + connection->in_size,
+                   connection->in_capacity - connection->in_size, 0);
+        if (got == 0)
+        {
+            return -1; // closed
+        }
+        if (got < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        connection->in_size += (int)got;
+    }
+    return 0;
+}
+
+int net_peek(Connection* connection, int* type,
+             const unsigned char** payload, int* size)
+{
+    const unsigned char* at = connection->in + connection->in_start;
+    int available = connection->in_size - connection->in_start;
+
+    if (available < MSG_HEADER_SIZE)
+    {
+        return 0;
+    }
+    *size = (int)get_u32(at + 1);
+    if (*size < 0 || *size > MSG_MAX_PAYLOAD)
+    {
+        return -1;
+    }
+    if (available < MSG_HEADER_SIZE + *size)
+    {
+        return 0;
+    }
+    *type = at[0];
+    *payload = at + MSG_HEADER_SIZE;
+    return 1;
+}
+
+void net_pop(Connection* connection)
+{
+    connection->in_start += MSG_HEADER_SIZE +
+        (int)get_u32(connection->in + connection->in_start + 1);
+}
+
+void put_u32(unsigned char* buf, unsigned int value)
+{
+    buf[0] = (unsigned char)value;
+    buf[1] = (unsigned char)(value >> 8);
+    buf[2] = (unsigned char)(value >> 16);
+    buf[3] = (unsigned char)(value >> 24);
+}
+
+unsigned int get_u32(const unsigned char* buf)
+{
+    return (unsigned int)buf[0] | ((unsigned int)buf[1] << 8) |
+           ((unsigned int)buf[2] << 16) | ((unsigned int)buf[3] << 24);
+}
+
+void put_u16(unsigned char* buf, unsigned int value)
+{
+    buf[0] = (unsigned char)value;
+    buf[1] = (unsigned char)(value >> 8);
+}
+
+unsigned int get_u16(const unsigned char* buf)
+{
+    return (unsigned int)buf[0] | ((unsigned int)buf[1] << 8);
+}
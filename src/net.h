@@ -0,0 +1,118 @@
+/*
+ * Networking shared by the chunk server and its clients: addresses,
+ * non-blocking connections and the message framing.
+ *
+ * Addresses are "unix:<path>" for a Unix socket or "<host>:<port>" for
+ * TCP.
+ *
+ * Every message is a 1-byte type and a 4-byte payload length, followed by
+ * the payload. All integers are little endian.
+ *
+ *   MSG_CAMERA (client to server): x, y, z (int32, 1/256 blocks) and the
+ *     view radius in chunks (int32). The server streams the chunks within
+ *     that radius of the camera.
+ *   MSG_EDIT (client to server): x, y, z (int32 block coordinates) and an
+ *     id (uint8).
+ *   MSG_CHUNK (server to client): cx, cy, cz (int32) and the chunk's ids
+ *     run-length coded (see compress.h).
+ *   MSG_DELTA (server to client): cx, cy, cz (int32) and changed blocks,
+ *     each an index (uint16, (dx * 16 + dy) * 16 + dz) and an id (uint8).
+ */
+
+#ifndef NET_H
+#define NET_H
+
+#define MSG_CAMERA 1
+#define MSG_EDIT 2
+#define MSG_CHUNK 3
+#define MSG_DELTA 4
+
+#define MSG_HEADER_SIZE 5
+#define MSG_MAX_PAYLOAD (1 << 16) // larger messages drop the connection
+// unhandled bytes read from a connection at most
+#define NET_MAX_INPUT (2 * (MSG_HEADER_SIZE + MSG_MAX_PAYLOAD))
+#define CHUNK_HEADER_SIZE 12 // cx, cy, cz of MSG_CHUNK and MSG_DELTA
+#define DELTA_ENTRY_SIZE 3
+#define CAMERA_SCALE 256.0f // MSG_CAMERA units per block
+// chunks up to this far past the view radius stay on the client. Farther
+// ones are dropped there and sent again in full when they come back.
+#define NET_KEEP_CHUNKS 1
+
+typedef struct ConnectionTag
+{
+    int fd;
+    unsigned char* in; // received bytes not handled yet
+    int in_start; // first byte of @in not handled yet
+    int in_size;
+    int in_capacity;
+    unsigned char* out; // bytes waiting to be sent
+    int out_size;
+    int out_capacity;
+} Connection;
+
+/*
+ * Listen on @address. Returns the listening socket (non-blocking) or -1.
+ */
+int net_listen(const char* address);
+
+/*
+ * Accept a pending connection on listening socket @fd. Returns the new
+ * socket (non-blocking) or -1 if there is none.
+ */
+int net_accept(int fd);
+
+/*
+ * Connect to @address. Returns the socket (non-blocking) or -1.
+ */
+int net_connect(const char* address);
+
+/*
+ * Construct a connection over socket @fd.
+ */
+Connection* construct_connection(int fd);
+
+/*
+ * Close a connection and free it.
+ */
+void destroy_connection(Connection* connection);
+
+/*
+ * Queue a message.
+ *
+ * @type: MSG_*.
+ */
+void net_send(Connection* connection, int type, const unsigned char* payload,
+              int size);
+
+/*
+ * Send as much of the queued data as the socket takes without blocking.
+ * Returns -1 if the connection broke.
+ */
+int net_flush(Connection* connection);
+
+/*
+ * Read what arrived without blocking, up to NET_MAX_INPUT bytes not
+ * handled yet. Whatever is left stays in the socket until the messages
+ * read so far are handled. Returns -1 if the connection was closed or
+ * broke.
+ */
+int net_receive(Connection* connection);
+
+/*
+ * Get the next complete message without removing it. Returns 0 if there is
+ * none yet, -1 if the peer sent garbage.
+ */
+int net_peek(Connection* connection, int* type,
+             const unsigned char** payload, int* size);
+
+/*
+ * Remove the message returned by net_peek().
+ */
+void net_pop(Connection* connection);
+
+void put_u32(unsigned char* buf, unsigned int value);
+unsigned int get_u32(const unsigned char* buf);
+void put_u16(unsigned char* buf, unsigned int value);
+unsigned int get_u16(const unsigned char* buf);
+
+#endif
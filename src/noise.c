@@ -0,0 +1,63 @@
+/*
+ * Implementation of value noise.
+ */
+
+#include <math.h>
+
+#include "noise.h"
+
+/*
+ * Get a pseudo-random value in [-1, 1] for a lattice point.
+ */
+static float lattice(int x, int z, unsigned int seed)
+{
+    unsigned int h = seed;
+
+    h ^= (unsigned int)x * 0x27d4eb2du;
+    h = (h ^ (h >> 15)) * 0x85ebca6bu;
+    h ^= (unsigned int)z * 0x165667b1u;
+    h = (h ^ (h >> 13)) * 0xc2b2ae35u;
+    h ^= h >> 16;
+    return (float)(h & 0xffffff) / (float)0x7fffff - 1.0f;
+}
+
+static float smooth(float t)
+{
+    return t * t * (3.0f - 2.0f * t);
+}
+
+float noise2(float x, float z, unsigned int seed)
+{
+    float fx = floorf(x);
+    float fz = floorf(z);
+    int ix = (int)fx;
+    int iz = (int)fz;
+    float tx = smooth(x - fx);
+    float tz = smooth(z - fz);
+    float near;
+    float far;
+
+    near = lattice(ix, iz, seed) +
+           tx * (lattice(ix + 1, iz, seed) - lattice(ix, iz, seed));
+    far = lattice(ix, iz + 1, seed) +
+          tx * (lattice(ix + 1, iz + 1, seed) - lattice(ix, iz + 1, seed));
+    return near + tz * (far - near);
+}
+
+float fbm2(float x, float z, int octaves, unsigned int seed)
+{
+    float sum = 0.0f;
+    float amplitude = 1.0f;
+    float total = 0.0f;
+    int octave;
+
+    for (octave = 0; octave < octaves; octave++)
+    {
+        sum += amplitude * noise2(x, z, seed + octave);
+        total += amplitude;
+        amplitude *= 0.5f;
+        x *= 2.0f;
+        z *= 2.0f;
+    }
+    return sum / total;
+}
@@ -0,0 +1,23 @@
+/*
+ * 2D value noise for terrain generation.
+ *
+ * Pure functions of their arguments, safe to call from any thread.
+ */
+
+#ifndef NOISE_H
+#define NOISE_H
+
+/*
+ * Get smooth noise in [-1, 1] at @x, @z. Lattice points are one unit apart.
+ *
+ * @seed: picks an independent noise field.
+ */
+float noise2(float x, float z, unsigned int seed);
+
+/*
+ * Get fractal noise in [-1, 1]: @octaves layers of noise2(), each at twice
+ * the frequency and half the amplitude of the one before.
+ */
+float fbm2(float x, float z, int octaves, unsigned int seed);
+
+#endif
@@ -0,0 +1,523 @@
+/*
+ * Implementation of the chunk pipeline.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "pipeline.h"
+#include "jobs.h"
+#include "mesh.h"
+#include "meshcache.h"
+#include "residency.h"
+#include "storage.h"
+
+static World* world;
+static StageFunc generate_func;
+static StageFunc light_func;
+static int radius;
+static int keep_radius;
+static int center[3];
+static int have_center = 0;
+static int meshing = 1;
+static int rescan = 0; // set by jobs canceled under a chunk that is wanted again
+static int pending_unloads = 0;
+
+static int want_data(void* arg)
+{
+    Chunk* chunk = arg;
+    return __atomic_load_n(&chunk->wanted, __ATOMIC_RELAXED) >= WANT_DATA;
+}
+
+static int want_mesh(void* arg)
+{
+    Chunk* chunk = arg;
+    return __atomic_load_n(&chunk->wanted, __ATOMIC_RELAXED) >= WANT_MESH;
+}
+
+/*
+ * Common tail of every stage job.
+ */
+static void stage_finished(Chunk* chunk, int canceled)
+{
+    if (canceled && want_data(chunk))
+    {
+        // canceled under a chunk that came back into range, look again
+        __atomic_store_n(&rescan, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_sub_fetch(&chunk->busy, 1, __ATOMIC_ACQ_REL);
+}
+
+static void generate_job(void* arg, int canceled)
+{
+    Chunk* chunk = arg;
+
+    // chunks read from disk already have their blocks
+    if (!canceled && chunk->io_state != IO_LOADED)
+    {
+        generate_func(chunk);
+    }
+    if (!canceled)
+    {
+        chunk_update_solid(chunk);
+    }
+    stage_finished(chunk, canceled);
+}
+
+static void light_job(void* arg, int canceled)
+{
+    Chunk* chunk = arg;
+
+    if (!canceled && light_func)
+    {
+        light_func(chunk);
+    }
+    stage_finished(chunk, canceled);
+}
+
+static void mesh_job(void* arg, int canceled)
+{
+    Chunk* chunk = arg;
+    Mesh* built;
+    Mesh* mesh;
+
+    if (!canceled)
+    {
+        built = mesh_cache_load(chunk);
+        if (built == NULL)
+        {
+            built = build_mesh(chunk);
+            mesh_cache_store(chunk, built);
+        }
+
+        // publish for the main thread, dropping a mesh it never picked up
+        mesh = __atomic_exchange_n(&chunk->pending_mesh, built,
+                                   __ATOMIC_ACQ_REL);
+        if (mesh)
+        {
+            destroy_mesh(mesh);
+        }
+    }
+    stage_finished(chunk, canceled);
+}
+
+/*
+ * Runs on the main thread when a chunk's read completed.
+ */
+static void chunk_loaded(Chunk* chunk)
+{
+    if (want_data(chunk))
+    {
+        // generation was held back by the read
+        __atomic_store_n(&rescan, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Create the job of a stage. The caller adds dependencies and passes the
+ * job to start_stage().
+ */
+static Job* create_stage(Chunk* chunk, int stage, int priority)
+{
+    static const JobFunc funcs[STAGE_COUNT] = {
+        generate_job, light_job, mesh_job
+    };
+    Job* job;
+
+    job = job_create(funcs[stage], chunk, priority);
+    job_set_check(job, stage == STAGE_MESH ? want_mesh : want_data);
+    return job;
+}
+
+static void start_stage(Chunk* chunk, int stage, Job* job)
+{
+    chunk_touch(chunk); // jobs only see uncompressed ids
+    if (chunk->jobs[stage])
+    {
+        job_release(chunk->jobs[stage]);
+    }
+    chunk->jobs[stage] = job;
+    __atomic_add_fetch(&chunk->busy, 1, __ATOMIC_ACQ_REL);
+    job_submit(job);
+}
+
+/*
+ * Check if a stage has to be (re)started: it never ran or it was canceled.
+ */
+static int needs_stage(Chunk* chunk, int stage)
+{
+    Job* job = chunk->jobs[stage];
+    return job == NULL || (job_done(job) && job_canceled(job));
+}
+
+/*
+ * Check if a chunk's blocks are known: read from disk, or known to be
+ * absent there. Starts the read the first time.
+ */
+static int chunk_ready(Chunk* chunk)
+{
+    if (chunk->io_state == IO_NONE)
+    {
+        storage_load(chunk, chunk_loaded);
+    }
+    return chunk->io_state == IO_LOADED || chunk->io_state == IO_ABSENT;
+}
+
+/*
+ * Chebyshev distance in chunks from the camera's chunk.
+ */
+static int distance(int cx, int cy, int cz)
+{
+    int d = abs(cx - center[0]);
+
+    if (abs(cy - center[1]) > d)
+    {
+        d = abs(cy - center[1]);
+    }
+    if (abs(cz - center[2]) > d)
+    {
+        d = abs(cz - center[2]);
+    }
+    return d;
+}
+
+static int priority_at(int d)
+{
+    if (d <= 1)
+    {
+        return JOB_PRIORITY_HIGH;
+    }
+    return (d <= radius) ? JOB_PRIORITY_NORMAL : JOB_PRIORITY_LOW;
+}
+
+/*
+ * Update how much every loaded chunk is wanted, canceling the jobs of the
+ * chunks that left the area.
+ */
+static void mark_chunks()
+{
+    Chunk* chunk;
+    int idx = 0;
+    int d;
+    int wanted;
+    int stage;
+    float now = residency_now();
+
+    while ((chunk = world_next(world, &idx)) != NULL)
+    {
+        d = distance(chunk_coord(chunk->a[0]), chunk_coord(chunk->a[1]),
+                     chunk_coord(chunk->a[2]));
+        wanted = (d <= radius) ? WANT_MESH :
+                 (d <= radius + 1) ? WANT_DATA :
+                 (d <= keep_radius) ? WANT_KEEP : WANT_NONE;
+        if (wanted == WANT_NONE && chunk->prefetched_at >= 0.0f &&
+            now - chunk->prefetched_at < PREFETCH_HOLD)
+        {
+            wanted = WANT_KEEP; // the camera is on its way
+        }
+        __atomic_store_n(&chunk->wanted, wanted, __ATOMIC_RELAXED);
+        if (wanted < WANT_DATA)
+        {
+            for (stage = 0; stage < STAGE_COUNT; stage++)
+            {
+                if (chunk->jobs[stage])
+                {
+                    job_cancel(chunk->jobs[stage]);
+                }
+            }
+        }
+        if (wanted == WANT_NONE)
+        {
+            pending_unloads = 1;
+        }
+    }
+}
+
+/*
+ * Check if a chunk and its neighbours all have a light job.
+ */
+static int lit_around(Chunk* chunk)
+{
+    Chunk* neighbour;
+    int dir;
+
+    if (chunk->jobs[STAGE_LIGHT] == NULL)
+    {
+        return 0;
+    }
+    for (dir = 0; dir < DIR_COUNT; dir++)
+    {
+        neighbour = world_get(world,
+                              chunk_coord(chunk->a[0]) + DIR_OFFSETS[dir][0],
+                              chunk_coord(chunk->a[1]) + DIR_OFFSETS[dir][1],
+                              chunk_coord(chunk->a[2]) + DIR_OFFSETS[dir][2]);
+        if (neighbour == NULL || neighbour->jobs[STAGE_LIGHT] == NULL)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Make sure every chunk in the area is loaded and has its jobs in flight.
+ */
+static void schedule_chunks()
+{
+    Chunk* chunk;
+    Chunk* neighbour;
+    Job* job;
+    int cx;
+    int cy;
+    int cz;
+    int d;
+    int dir;
+    int reach = radius + 1;
+
+    // generate and light everything a mesh may depend on
+    for (cx = center[0] - reach; cx <= center[0] + reach; cx++)
+    {
+        for (cy = center[1] - reach; cy <= center[1] + reach; cy++)
+        {
+            for (cz = center[2] - reach; cz <= center[2] + reach; cz++)
+            {
+                d = distance(cx, cy, cz);
+                chunk = world_add(world, cx, cy, cz);
+                __atomic_store_n(&chunk->wanted,
+                                 d <= radius ? WANT_MESH : WANT_DATA,
+                                 __ATOMIC_RELAXED);
+                if (!chunk_ready(chunk))
+                {
+                    continue; // scheduled again once the read completes
+                }
+                if (needs_stage(chunk, STAGE_GENERATE))
+                {
+                    job = create_stage(chunk, STAGE_GENERATE, priority_at(d));
+                    start_stage(chunk, STAGE_GENERATE, job);
+                }
+                if (needs_stage(chunk, STAGE_LIGHT))
+                {
+                    job = create_stage(chunk, STAGE_LIGHT, priority_at(d));
+                    job_depends_on(job, chunk->jobs[STAGE_GENERATE]);
+                    start_stage(chunk, STAGE_LIGHT, job);
+                }
+            }
+        }
+    }
+
+    // mesh everything in view once it and its neighbours are lit. Chunks
+    // with a neighbour still being read wait for the rescan. Hidden chunks
+    // are skipped, they are meshed when drawn if a neighbour opens them up.
+    if (!meshing)
+    {
+        return;
+    }
+    for (cx = center[0] - radius; cx <= center[0] + radius; cx++)
+    {
+        for (cy = center[1] - radius; cy <= center[1] + radius; cy++)
+        {
+            for (cz = center[2] - radius; cz <= center[2] + radius; cz++)
+            {
+                chunk = world_get(world, cx, cy, cz);
+                if (!needs_stage(chunk, STAGE_MESH) || !lit_around(chunk) ||
+                    world_chunk_hidden(world, chunk))
+                {
+                    continue;
+                }
+                job = create_stage(chunk, STAGE_MESH,
+                                   priority_at(distance(cx, cy, cz)));
+                job_depends_on(job, chunk->jobs[STAGE_LIGHT]);
+                for (dir = 0; dir < DIR_COUNT; dir++)
+                {
+                    neighbour = world_get(world, cx + DIR_OFFSETS[dir][0],
+                                          cy + DIR_OFFSETS[dir][1],
+                                          cz + DIR_OFFSETS[dir][2]);
+                    job_depends_on(job, neighbour->jobs[STAGE_LIGHT]);
+                }
+                start_stage(chunk, STAGE_MESH, job);
+            }
+        }
+    }
+}
+
+/*
+ * Free the chunks that are no longer wanted and no longer used by jobs.
+ */
+static void unload_chunks()
+{
+    Chunk** doomed;
+    Chunk* chunk;
+    int count = 0;
+    int idx = 0;
+
+    doomed = malloc(world->count * sizeof(Chunk*));
+    pending_unloads = 0;
+    while ((chunk = world_next(world, &idx)) != NULL)
+    {
+        if (__atomic_load_n(&chunk->wanted, __ATOMIC_RELAXED) != WANT_NONE)
+        {
+            continue;
+        }
+        if (__atomic_load_n(&chunk->busy, __ATOMIC_ACQUIRE) == 0)
+        {
+            doomed[count++] = chunk;
+        }
+        else
+        {
+            pending_unloads = 1; // try again next frame
+        }
+    }
+    for (idx = 0; idx < count; idx++)
+    {
+        pipeline_unload(doomed[idx]);
+    }
+    free(doomed);
+}
+
+void pipeline_init(World* new_world, StageFunc generate, StageFunc light,
+                   int new_radius, int new_keep_radius)
+{
+    world = new_world;
+    generate_func = generate;
+    light_func = light;
+    radius = new_radius;
+    keep_radius = new_keep_radius;
+    have_center = 0;
+}
+
+void pipeline_set_radius(int new_radius)
+{
+    if (new_radius != radius)
+    {
+        radius = new_radius;
+        have_center = 0; // rescan everything
+    }
+}
+
+void pipeline_set_meshing(int enabled)
+{
+    meshing = enabled;
+}
+
+int pipeline_radius()
+{
+    return radius;
+}
+
+void pipeline_update(const float* p)
+{
+    int c[3];
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        c[i] = chunk_coord((int)floorf(p[i]));
+    }
+
+    if (!have_center || c[0] != center[0] || c[1] != center[1] ||
+        c[2] != center[2] || __atomic_exchange_n(&rescan, 0, __ATOMIC_RELAXED))
+    {
+        for (i = 0; i < 3; i++)
+        {
+            center[i] = c[i];
+        }
+        have_center = 1;
+        mark_chunks();
+        schedule_chunks();
+    }
+
+    if (pending_unloads)
+    {
+        unload_chunks();
+    }
+}
+
+void pipeline_prefetch(const float* p, const float* v)
+{
+    Chunk* chunk;
+    float now = residency_now();
+    int issued = 0;
+    int c[3];
+    int step;
+    int i;
+    int dx;
+    int dy;
+    int dz;
+
+    for (step = 1; step <= PREFETCH_STEPS; step++)
+    {
+        for (i = 0; i < 3; i++)
+        {
+            c[i] = chunk_coord((int)floorf(p[i] + v[i] * PREFETCH_STEP * step));
+        }
+        if (distance(c[0], c[1], c[2]) <= radius + 1)
+        {
+            continue; // already loaded by pipeline_update()
+        }
+
+        for (dx = -1; dx <= 1; dx++)
+        {
+            for (dy = -1; dy <= 1; dy++)
+            {
+                for (dz = -1; dz <= 1; dz++)
+                {
+                    chunk = world_add(world, c[0] + dx, c[1] + dy, c[2] + dz);
+                    chunk->prefetched_at = now;
+                    if (chunk->wanted == WANT_NONE)
+                    {
+                        __atomic_store_n(&chunk->wanted, WANT_KEEP,
+                                         __ATOMIC_RELAXED);
+                    }
+                    if (chunk->io_state == IO_NONE)
+                    {
+                        if (issued == PREFETCH_PER_FRAME)
+                        {
+                            return;
+                        }
+                        storage_load(chunk, chunk_loaded);
+                        issued++;
+                    }
+                }
+            }
+        }
+    }
+}
+
+int pipeline_unload(Chunk* chunk)
+{
+    if (__atomic_load_n(&chunk->busy, __ATOMIC_ACQUIRE) != 0)
+    {
+        return 0;
+    }
+    if (chunk->modified)
+    {
+        storage_save(chunk);
+    }
+    world_remove(world, chunk);
+    destroy_chunk(chunk);
+    return 1;
+}
+
+int pipeline_remesh(Chunk* chunk)
+{
+    Job* job = chunk->jobs[STAGE_MESH];
+
+    if (job && !job_done(job))
+    {
+        return 0;
+    }
+
+    job = create_stage(chunk, STAGE_MESH, JOB_PRIORITY_HIGH);
+    if (chunk->jobs[STAGE_LIGHT])
+    {
+        job_depends_on(job, chunk->jobs[STAGE_LIGHT]);
+    }
+    start_stage(chunk, STAGE_MESH, job);
+    return 1;
+}
+
+int stage_done(Chunk* chunk, int stage)
+{
+    Job* job = chunk->jobs[stage];
+    return job != NULL && job_done(job) && !job_canceled(job);
+}
@@ -0,0 +1,102 @@
+/*
+ * The chunk pipeline: loads the chunks around the camera and brings each
+ * one through generation, lighting and meshing on the job system.
+ *
+ * Every chunk inside the view radius is meshed, and meshing a chunk waits
+ * until the chunk and its six neighbours are generated and lit. The ring
+ * of chunks just outside the view radius is therefore generated and lit
+ * but not meshed. Hidden chunks (see world_chunk_hidden()) are not meshed
+ * at all until an edit next to them opens them up. Jobs whose chunk has
+ * left that area before they started are canceled. Chunks stay loaded,
+ * without jobs, up to the keep radius so revisits are instant (see
+ * residency.h), and are unloaded beyond it.
+ *
+ * A new chunk is first looked up on disk (see storage.h) and only
+ * generated if it was never saved. Edited chunks are saved when they are
+ * unloaded. To hide the disk from a fast moving camera, chunks along its
+ * path are read ahead of time by pipeline_prefetch().
+ *
+ * The stage functions run on worker threads and may only touch the chunk
+ * they are given. Everything else here runs on the main thread.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "chunk.h"
+#include "world.h"
+
+#define PREFETCH_STEP 0.5f // seconds between predicted camera positions
+#define PREFETCH_STEPS 4 // predicted positions, up to 2 seconds ahead
+#define PREFETCH_PER_FRAME 32 // chunk reads started per frame at most
+#define PREFETCH_HOLD 4.0f // seconds a prefetched chunk is kept loaded
+
+/*
+ * Work done on a chunk by one stage of the pipeline.
+ */
+typedef void (*StageFunc)(Chunk* chunk);
+
+/*
+ * Set up the pipeline. Call after jobs_init().
+ *
+ * @world: world the pipeline loads chunks into.
+ * @generate: fills in the block ids of a new chunk.
+ * @light: lights a generated chunk, NULL if there is no lighting.
+ * @radius: view radius in chunks.
+ * @keep_radius: radius in chunks up to which chunks stay loaded.
+ */
+void pipeline_init(World* world, StageFunc generate, StageFunc light,
+                   int radius, int keep_radius);
+
+/*
+ * Change the view radius (in chunks).
+ */
+void pipeline_set_radius(int radius);
+
+/*
+ * Turn meshing on or off. A headless server (see server.h) only needs the
+ * blocks.
+ */
+void pipeline_set_meshing(int enabled);
+
+/*
+ * Get the view radius (in chunks).
+ */
+int pipeline_radius();
+
+/*
+ * Load, schedule and unload chunks for a camera at @p (x, y, z). Call once
+ * per frame.
+ */
+void pipeline_update(const float* p);
+
+/*
+ * Start reading the chunks the camera is about to reach. Call once per
+ * frame after pipeline_update().
+ *
+ * @p: camera position (x, y, z).
+ * @v: camera velocity in blocks per second.
+ */
+void pipeline_prefetch(const float* p, const float* v);
+
+/*
+ * Unload a chunk right away, saving it first if it was edited. Returns 0
+ * if jobs or I/O are still using the chunk.
+ */
+int pipeline_unload(Chunk* chunk);
+
+/*
+ * Rebuild the baked mesh of a chunk whose blocks changed. Returns 0 if a
+ * mesh job is still in flight for the chunk and the caller should try
+ * again later.
+ */
+int pipeline_remesh(Chunk* chunk);
+
+/*
+ * Check if a stage has finished for a chunk without being canceled.
+ *
+ * @stage: STAGE_*.
+ */
+int stage_done(Chunk* chunk, int stage);
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ * Implementation of chunk residency tiers.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "residency.h"
+#include "compress.h"
+#include "util.h"
+#include "faces.h"
+#include "jobs.h"
+#include "mesh.h"
+
+static float clock_now = 0.0f;
+static float last_sweep = 0.0f;
+static ResidencyStats stats;
+
+static const char* tier_names[TIER_COUNT] = {"hot", "cold"};
+
+/*
+ * Free the render data of a chunk that is out of view. Its mesh job is
+ * forgotten so the pipeline meshes it again when it comes back.
+ */
+static void drop_render_data(Chunk* chunk)
+{
+    if (chunk->mesh)
+    {
+        destroy_mesh(chunk->mesh);
+        chunk->mesh = NULL;
+    }
+    if (chunk->pending_mesh)
+    {
+        destroy_mesh(chunk->pending_mesh);
+        chunk->pending_mesh = NULL;
+    }
+    if (chunk->faces)
+    {
+        destroy_face_buffer(chunk->faces);
+        chunk->faces = NULL;
+    }
+    chunk->render_path = RENDER_PATH_BAKED;
+    if (chunk->jobs[STAGE_MESH])
+    {
+        job_release(chunk->jobs[STAGE_MESH]);
+        chunk->jobs[STAGE_MESH] = NULL;
+    }
+}
+
+void chunk_touch(Chunk* chunk)
+{
+    chunk->last_access = clock_now;
+    if (chunk->ids != NULL)
+    {
+        return;
+    }
+
+    chunk->ids = malloc(BLOCKS_PER_CHUNK);
+    rle_decode(chunk->packed, chunk->packed_size, (unsigned char*)chunk->ids,
+               BLOCKS_PER_CHUNK);
+    free(chunk->packed);
+    chunk->packed = NULL;
+    chunk->packed_size = 0;
+    stats.decompressions++;
+}
+
+int chunk_tier(const Chunk* chunk)
+{
+    return (chunk->ids != NULL) ? TIER_HOT : TIER_COLD;
+}
+
+int chunk_compress(Chunk* chunk)
+{
+    if (chunk->ids == NULL ||
+        __atomic_load_n(&chunk->busy, __ATOMIC_ACQUIRE) != 0)
+    {
+        return 0;
+    }
+
+    chunk->packed_size = rle_encode((const unsigned char*)chunk->ids,
+                                    BLOCKS_PER_CHUNK, &chunk->packed);
+    free(chunk->ids);
+    chunk->ids = NULL;
+    stats.compressions++;
+    return 1;
+}
+
+void residency_update(World* world, const float* p, float now)
+{
+    Chunk* chunk;
+    float limit;
+    int idx = 0;
+    int tier;
+    int d;
+    int i;
+
+    clock_now = now;
+    if (now - last_sweep < RESIDENCY_INTERVAL)
+    {
+        return;
+    }
+    last_sweep = now;
+
+    for (tier = 0; tier < TIER_COUNT; tier++)
+    {
+        stats.chunks[tier] = 0;
+        stats.bytes[tier] = 0;
+    }
+
+    while ((chunk = world_next(world, &idx)) != NULL)
+    {
+        // Chebyshev distance in chunks from the camera
+        d = 0;
+        for (i = 0; i < 3; i++)
+        {
+            d = MAX(d, abs(chunk_coord(chunk->a[i]) -
+                           chunk_coord((int)floorf(p[i]))));
+        }
+
+        if (d > HOT_CHUNKS && chunk->ids != NULL)
+        {
+            // farther chunks may idle for less time
+            limit = COMPRESS_IDLE_SECONDS * (HOT_CHUNKS + 1) / d;
+            if (now - chunk->last_access > limit)
+            {
+                chunk_compress(chunk);
+            }
+        }
+        if (chunk->ids == NULL &&
+            __atomic_load_n(&chunk->wanted, __ATOMIC_RELAXED) < WANT_MESH &&
+            __atomic_load_n(&chunk->busy, __ATOMIC_ACQUIRE) == 0)
+        {
+            drop_render_data(chunk);
+        }
+
+        tier = chunk_tier(chunk);
+        stats.chunks[tier]++;
+        stats.bytes[tier] += (tier == TIER_HOT) ? BLOCKS_PER_CHUNK
+                                                : chunk->packed_size;
+    }
+}
+
+float residency_now()
+{
+    return clock_now;
+}
+
+const ResidencyStats* residency_stats()
+{
+    return &stats;
+}
+
+void residency_print(FILE* file)
+{
+    int tier;
+
+    fprintf(file, "residency:");
+    for (tier = 0; tier < TIER_COUNT; tier++)
+    {
+        fprintf(file, " %s %d chunks %ld KiB,", tier_names[tier],
+                stats.chunks[tier], stats.bytes[tier] / 1024);
+    }
+    fprintf(file, " %ld compressed, %ld decompressed\n",
+            stats.compressions, stats.decompressions);
+}
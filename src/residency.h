@@ -0,0 +1,81 @@
+/*
+ * Residency tiers of chunk data.
+ *
+ * Chunks start hot: their block ids sit uncompressed in memory. A chunk
+ * that nobody touched for a while is moved to the cold tier, where its ids
+ * are run-length coded (see compress.h). The first access through
+ * chunk_touch() brings it back. How long a chunk may stay idle depends on
+ * its distance to the camera: chunks next to the camera are never
+ * compressed, and the farther a chunk is, the sooner it gets compressed.
+ *
+ * Cold chunks outside the view radius also drop their render data, which
+ * the pipeline rebuilds when they come back into view.
+ *
+ * Everything here runs on the main thread. Chunks with jobs in flight are
+ * never compressed, so jobs always see uncompressed ids.
+ */
+
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+#include <stdio.h>
+
+#include "chunk.h"
+#include "world.h"
+
+#define COMPRESS_IDLE_SECONDS 10.0f // idle time before compressing
+#define HOT_CHUNKS 2 // chunks this close to the camera stay hot
+#define RESIDENCY_INTERVAL 0.5f // seconds between sweeps
+
+// tiers
+#define TIER_HOT 0
+#define TIER_COLD 1
+#define TIER_COUNT 2
+
+typedef struct ResidencyStatsTag
+{
+    int chunks[TIER_COUNT]; // chunks in each tier
+    long bytes[TIER_COUNT]; // bytes of block ids in each tier
+    long compressions; // since start
+    long decompressions; // since start
+} ResidencyStats;
+
+/*
+ * Make sure a chunk's ids are uncompressed and mark it as just used.
+ */
+void chunk_touch(Chunk* chunk);
+
+/*
+ * Get the tier (TIER_*) of a chunk.
+ */
+int chunk_tier(const Chunk* chunk);
+
+/*
+ * Compress a chunk's ids. Returns 0 if the chunk is already compressed or
+ * jobs are using it.
+ */
+int chunk_compress(Chunk* chunk);
+
+/*
+ * Advance the residency clock to @now (seconds) and, every
+ * RESIDENCY_INTERVAL seconds, compress the idle chunks of @world given a
+ * camera at @p (x, y, z).
+ */
+void residency_update(World* world, const float* p, float now);
+
+/*
+ * Get the residency clock, in seconds.
+ */
+float residency_now();
+
+/*
+ * Get the counters of the last sweep.
+ */
+const ResidencyStats* residency_stats();
+
+/*
+ * Print the counters of the last sweep on one line.
+ */
+void residency_print(FILE* file);
+
+#endif
@@ -0,0 +1,574 @@
+/*
+ * Implementation of the headless chunk server.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "asyncio.h"
+#include "budget.h"
+#include "compress.h"
+#include "jobs.h"
+#include "net.h"
+#include "pipeline.h"
+#include "residency.h"
+#include "storage.h"
+#include "terrain.h"
+
+typedef struct ClientTag
+{
+    Connection* connection; // NULL if the slot is free
+    unsigned long serial; // order of connection
+    float p[3]; // camera
+    int c[3]; // chunk of the camera
+    int radius; // view radius in chunks
+    int have_camera;
+} Client;
+
+/*
+ * A block changed since the last update.
+ */
+typedef struct EditTag
+{
+    int c[3]; // chunk coordinates
+    int order; // keeps edits of one block in order
+    unsigned short index; // (dx * CHUNK_SIZE + dy) * CHUNK_SIZE + dz
+    unsigned char id;
+} Edit;
+
+/*
+ * A chunk a client still has to get.
+ */
+typedef struct CandidateTag
+{
+    Chunk* chunk;
+    int d;
+} Candidate;
+
+static World* world;
+static int listen_fd = -1;
+static Client clients[SERVER_MAX_CLIENTS];
+static unsigned long next_serial = 0;
+static Edit* edits = NULL;
+static int edit_count = 0;
+static int edit_capacity = 0;
+static volatile sig_atomic_t quit = 0;
+
+/*
+ * Chebyshev distance in chunks from a client's camera.
+ */
+static int client_distance(const Client* client, const Chunk* chunk)
+{
+    int d = 0;
+    int i;
+    int di;
+
+    for (i = 0; i < 3; i++)
+    {
+        di = abs(chunk_coord(chunk->a[i]) - client->c[i]);
+        if (di > d)
+        {
+            d = di;
+        }
+    }
+    return d;
+}
+
+static void accept_clients()
+{
+    int fd;
+    int i;
+
+    while ((fd = net_accept(listen_fd)) >= 0)
+    {
+        for (i = 0; i < SERVER_MAX_CLIENTS; i++)
+        {
+            if (clients[i].connection == NULL)
+            {
+                break;
+            }
+        }
+        if (i == SERVER_MAX_CLIENTS)
+        {
+            fprintf(stderr, "Server full, refusing a client.\n");
+            close(fd);
+            continue;
+        }
+        clients[i].connection = construct_connection(fd);
+        clients[i].serial = next_serial++;
+        clients[i].have_camera = 0;
+        printf("Client %d connected.\n", i);
+    }
+}
+
+static void drop_client(int slot)
+{
+    Chunk* chunk;
+    int idx = 0;
+
+    destroy_connection(clients[slot].connection);
+    clients[slot].connection = NULL;
+    while ((chunk = world_next(world, &idx)) != NULL)
+    {
+        chunk->subscribers &= ~(1u << slot);
+    }
+    printf("Client %d disconnected.\n", slot);
+}
+
+static void handle_message(int slot, int type, const unsigned char* payload,
+                           int size)
+{
+    Client* client = &clients[slot];
+    int i;
+
+    if (type == MSG_CAMERA && size >= 16)
+    {
+        for (i = 0; i < 3; i++)
+        {
+            client->p[i] = (int)get_u32(payload + 4 * i) / CAMERA_SCALE;
+            client->c[i] = chunk_coord((int)floorf(client->p[i]));
+        }
+        client->radius = (int)get_u32(payload + 12);
+        if (client->radius < 0)
+        {
+            client->radius = 0;
+        }
+        if (client->radius > SERVER_MAX_RADIUS)
+        {
+            client->radius = SERVER_MAX_RADIUS;
+        }
+        client->have_camera = 1;
+    }
+    else if (type == MSG_EDIT && size >= 13)
+    {
+        server_edit((int)get_u32(payload), (int)get_u32(payload + 4),
+                    (int)get_u32(payload + 8), payload[12]);
+    }
+}
+
+static int same_chunk(const Edit* a, const Edit* b)
+{
+    return a->c[0] == b->c[0] && a->c[1] == b->c[1] && a->c[2] == b->c[2];
+}
+
+static int compare_edits(const void* a, const void* b)
+{
+    const Edit* ea = a;
+    const Edit* eb = b;
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (ea->c[i] != eb->c[i])
+        {
+            return (ea->c[i] < eb->c[i]) ? -1 : 1;
+        }
+    }
+    return ea->order - eb->order;
+}
+
+/*
+ * Send the edits since the last update, one MSG_DELTA per chunk and
+ * client holding it.
+ */
+static void send_deltas()
+{
+    unsigned char* payload;
+    unsigned char* at;
+    Chunk* chunk;
+    int start;
+    int end;
+    int count;
+    int slot;
+    int i;
+
+    if (edit_count == 0)
+    {
+        return;
+    }
+    qsort(edits, edit_count, sizeof(Edit), compare_edits);
+    payload = malloc(MSG_MAX_PAYLOAD);
+
+    for (start = 0; start < edit_count; start = end)
+    {
+        end = start + 1;
+        while (end < edit_count && same_chunk(&edits[start], &edits[end]))
+        {
+            end++;
+        }
+        // a chunk unloaded meanwhile is sent in full when it comes back
+        chunk = world_get(world, edits[start].c[0], edits[start].c[1],
+                          edits[start].c[2]);
+        if (chunk == NULL || chunk->subscribers == 0)
+        {
+            continue;
+        }
+
+        for (i = start; i < end; i += count)
+        {
+            count = end - i;
+            if (count > (MSG_MAX_PAYLOAD - CHUNK_HEADER_SIZE) /
+                        DELTA_ENTRY_SIZE)
+            {
+                count = (MSG_MAX_PAYLOAD - CHUNK_HEADER_SIZE) /
+                        DELTA_ENTRY_SIZE;
+            }
+            put_u32(payload, (unsigned int)edits[start].c[0]);
+            put_u32(payload + 4, (unsigned int)edits[start].c[1]);
+            put_u32(payload + 8, (unsigned int)edits[start].c[2]);
+            at = payload + CHUNK_HEADER_SIZE;
+            for (slot = 0; slot < count; slot++)
+            {
+                put_u16(at, edits[i + slot].index);
+                at[2] = edits[i + slot].id;
+                at += DELTA_ENTRY_SIZE;
+            }
+            for (slot = 0; slot < SERVER_MAX_CLIENTS; slot++)
+            {
+                if (chunk->subscribers & (1u << slot))
+                {
+                    net_send(clients[slot].connection, MSG_DELTA, payload,
+                             CHUNK_HEADER_SIZE + count * DELTA_ENTRY_SIZE);
+                }
+            }
+        }
+    }
+
+    free(payload);
+    edit_count = 0;
+}
+
+static void send_chunk(int slot, Chunk* chunk)
+{
+    unsigned char* payload;
+    unsigned char* rle = NULL;
+    const unsigned char* data;
+    int size;
+
+    // compressed chunks are already in wire format
+    if (chunk->ids == NULL)
+    {
+        data = chunk->packed;
+        size = chunk->packed_size;
+    }
+    else
+    {
+        size = rle_encode((const unsigned char*)chunk->ids, BLOCKS_PER_CHUNK,
+                          &rle);
+        data = rle;
+    }
+
+    payload = malloc(CHUNK_HEADER_SIZE + size);
+    put_u32(payload, (unsigned int)chunk_coord(chunk->a[0]));
+    put_u32(payload + 4, (unsigned int)chunk_coord(chunk->a[1]));
+    put_u32(payload + 8, (unsigned int)chunk_coord(chunk->a[2]));
+    memcpy(payload + CHUNK_HEADER_SIZE, data, size);
+    net_send(clients[slot].connection, MSG_CHUNK, payload,
+             CHUNK_HEADER_SIZE + size);
+    chunk->subscribers |= 1u << slot;
+
+    free(payload);
+    free(rle);
+}
+
+static int compare_candidates(const void* a, const void* b)
+{
+    return ((const Candidate*)a)->d - ((const Candidate*)b)->d;
+}
+
+/*
+ * Send a client the chunks in its view it does not have yet, nearest
+ * first, until its backlog is full. Forget the chunks the client dropped.
+ */
+static void send_chunks(int slot)
+{
+    Client* client = &clients[slot];
+    Candidate* candidates;
+    Chunk* chunk;
+    unsigned int bit = 1u << slot;
+    int count = 0;
+    int idx = 0;
+    int d;
+
+    if (!client->have_camera)
+    {
+        return;
+    }
+
+    candidates = malloc(world->count * sizeof(Candidate));
+    while ((chunk = world_next(world, &idx)) != NULL)
+    {
+        d = client_distance(client, chunk);
+        if (chunk->subscribers & bit)
+        {
+            if (d > client->radius + NET_KEEP_CHUNKS)
+            {
+                chunk->subscribers &= ~bit;
+            }
+        }
+        else if (d <= client->radius &&
+                 __atomic_load_n(&chunk->solid_ready, __ATOMIC_ACQUIRE))
+        {
+            candidates[count].chunk = chunk;
+            candidates[count].d = d;
+            count++;
+        }
+    }
+    qsort(candidates, count, sizeof(Candidate), compare_candidates);
+
+    for (idx = 0; idx < count &&
+         client->connection->out_size < SERVER_BACKLOG; idx++)
+    {
+        send_chunk(slot, candidates[idx].chunk);
+    }
+    free(candidates);
+}
+
+static void on_signal(int signal)
+{
+    (void)signal;
+    quit = 1;
+}
+
+int server_init(World* new_world, const char* address)
+{
+    int i;
+
+    world = new_world;
+    listen_fd = net_listen(address);
+    if (listen_fd < 0)
+    {
+        return 1;
+    }
+    for (i = 0; i < SERVER_MAX_CLIENTS; i++)
+    {
+        clients[i].connection = NULL;
+    }
+    printf("Serving on %s\n", address);
+    return 0;
+}
+
+void server_shutdown()
+{
+    int i;
+
+    for (i = 0; i < SERVER_MAX_CLIENTS; i++)
+    {
+        if (clients[i].connection)
+        {
+            net_flush(clients[i].connection);
+            drop_client(i);
+        }
+    }
+    if (listen_fd >= 0)
+    {
+        close(listen_fd);
+        listen_fd = -1;
+    }
+    free(edits);
+    edits = NULL;
+    edit_count = 0;
+    edit_capacity = 0;
+}
+
+void server_update(int timeout_ms)
+{
+    struct pollfd fds[SERVER_MAX_CLIENTS + 1];
+    int slots[SERVER_MAX_CLIENTS + 1];
+    const unsigned char* payload;
+    int count = 1;
+    int type;
+    int size;
+    int got;
+    int i;
+
+    fds[0].fd = listen_fd;
+    fds[0].events = POLLIN;
+    for (i = 0; i < SERVER_MAX_CLIENTS; i++)
+    {
+        if (clients[i].connection)
+        {
+            fds[count].fd = clients[i].connection->fd;
+            fds[count].events = POLLIN;
+            if (clients[i].connection->out_size > 0)
+            {
+                fds[count].events |= POLLOUT;
+            }
+            slots[count] = i;
+            count++;
+        }
+    }
+    if (poll(fds, count, timeout_ms) < 0)
+    {
+        return; // interrupted
+    }
+
+    if (fds[0].revents & POLLIN)
+    {
+        accept_clients();
+    }
+    for (i = 1; i < count; i++)
+    {
+        if (fds[i].revents == 0)
+        {
+            continue;
+        }
+        if (net_receive(clients[slots[i]].connection) != 0)
+        {
+            drop_client(slots[i]);
+            continue;
+        }
+        while ((got = net_peek(clients[slots[i]].connection, &type, &payload,
+                               &size)) == 1)
+        {
+            handle_message(slots[i], type, payload, size);
+            net_pop(clients[slots[i]].connection);
+        }
+        if (got < 0)
+        {
+            fprintf(stderr, "Client %d sent garbage.\n", slots[i]);
+            drop_client(slots[i]);
+        }
+    }
+
+    // changes first, so chunks sent in full below already contain them
+    send_deltas();
+    for (i = 0; i < SERVER_MAX_CLIENTS; i++)
+    {
+        if (clients[i].connection == NULL)
+        {
+            continue;
+        }
+        send_chunks(i);
+        if (net_flush(clients[i].connection) != 0)
+        {
+            drop_client(i);
+        }
+    }
+}
+
+int server_edit(int x, int y, int z, int id)
+{
+    Chunk* chunk;
+    Edit* edit;
+    int c[3] = {chunk_coord(x), chunk_coord(y), chunk_coord(z)};
+    int dx;
+    int dy;
+    int dz;
+
+    chunk = world_get(world, c[0], c[1], c[2]);
+    if (chunk == NULL || !__atomic_load_n(&chunk->solid_ready,
+                                          __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+    dx = x - chunk->a[0];
+    dy = y - chunk->a[1];
+    dz = z - chunk->a[2];
+    if (get_block(chunk, dx, dy, dz) == id)
+    {
+        return 1;
+    }
+    set_block(chunk, id, dx, dy, dz);
+
+    if (edit_count == edit_capacity)
+    {
+        edit_capacity = edit_capacity ? edit_capacity * 2 : 64;
+        edits = realloc(edits, edit_capacity * sizeof(Edit));
+    }
+    edit = &edits[edit_count];
+    edit->c[0] = c[0];
+    edit->c[1] = c[1];
+    edit->c[2] = c[2];
+    edit->order = edit_count;
+    edit->index = (unsigned short)((dx * CHUNK_SIZE + dy) * CHUNK_SIZE + dz);
+    edit->id = (unsigned char)id;
+    edit_count++;
+    return 1;
+}
+
+int server_camera(float* p, int* radius)
+{
+    Client* oldest = NULL;
+    int i;
+
+    for (i = 0; i < SERVER_MAX_CLIENTS; i++)
+    {
+        if (clients[i].connection && clients[i].have_camera &&
+            (oldest == NULL || clients[i].serial < oldest->serial))
+        {
+            oldest = &clients[i];
+        }
+    }
+    if (oldest == NULL)
+    {
+        return 0;
+    }
+    for (i = 0; i < 3; i++)
+    {
+        p[i] = oldest->p[i];
+    }
+    *radius = oldest->radius;
+    return 1;
+}
+
+int server_run(const char* address)
+{
+    struct timespec start;
+    struct timespec now;
+    World* server_world;
+    float seconds;
+    float p[3];
+    int radius;
+
+    jobs_init(0);
+    if (async_init(0) != 0 || storage_init(WORLD_DIR) != 0)
+    {
+        fprintf(stderr, "Could not set up world storage.\n");
+        return 1;
+    }
+    server_world = construct_world();
+    pipeline_init(server_world, generate_terrain, NULL, 0, SERVER_KEEP_CHUNKS);
+    pipeline_set_meshing(0);
+    if (server_init(server_world, address) != 0)
+    {
+        return 1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (!quit)
+    {
+        server_update(SERVER_TICK_MS);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        seconds = (float)(now.tv_sec - start.tv_sec) +
+                  (now.tv_nsec - start.tv_nsec) * 1e-9f;
+
+        async_poll();
+        if (server_camera(p, &radius))
+        {
+            pipeline_set_radius(radius);
+            pipeline_update(p);
+            residency_update(server_world, p, seconds);
+        }
+        async_submit();
+        budget_update(server_world, seconds);
+    }
+
+    // save edits before quitting
+    server_shutdown();
+    storage_flush(server_world);
+    async_shutdown();
+    storage_shutdown();
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * Headless chunk server. The server owns the world: it generates, edits and
+ * saves the chunks, and streams them to clients (see client.h) over a TCP
+ * or Unix socket (see net.h).
+ *
+ * Every client reports its camera and view radius. The server sends each
+ * chunk within that radius once in full, nearest first, and afterwards only
+ * the blocks that change in it, batched per chunk and update. Client edits
+ * are applied here and come back to every client holding the chunk like
+ * any other change. Which clients hold a chunk is kept in the chunk itself
+ * (Chunk.subscribers), so a chunk the server unloads is sent again in full
+ * when it comes back.
+ *
+ * The pipeline loads chunks around one camera, that of the client that
+ * connected first. Other clients are served what is loaded.
+ *
+ * Everything here runs on the main thread.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "world.h"
+
+#define SERVER_MAX_CLIENTS 32 // one bit each in Chunk.subscribers
+#define SERVER_MAX_RADIUS 8 // largest view radius served, in chunks
+#define SERVER_KEEP_CHUNKS 10 // radius in chunks that stays loaded
+#define SERVER_BACKLOG (256 * 1024) // queued bytes that hold back chunks
+#define SERVER_TICK_MS 16 // longest wait for network traffic per update
+
+/*
+ * Start serving @world on @address. Returns 0 on success.
+ */
+int server_init(World* world, const char* address);
+
+/*
+ * Disconnect every client and stop listening.
+ */
+void server_shutdown();
+
+/*
+ * Accept clients, handle their messages and send them chunks and changes.
+ * Waits up to @timeout_ms for traffic.
+ */
+void server_update(int timeout_ms);
+
+/*
+ * Set a block and pass the change on to the clients holding its chunk.
+ * Returns 0 if the chunk is not loaded.
+ *
+ * @x, @y, @z: block coordinates.
+ */
+int server_edit(int x, int y, int z, int id);
+
+/*
+ * Get the camera the pipeline follows. Returns 0 if no client reported one.
+ *
+ * @p: receives the camera position (x, y, z).
+ * @radius: receives the view radius in chunks.
+ */
+int server_camera(float* p, int* radius);
+
+/*
+ * Run a headless server on @address until interrupted, then save the world.
+ * Returns the exit status.
+ */
+int server_run(const char* address);
+
+#endif
@@ -0,0 +1,385 @@
+/*
+ * Implementation of on-disk chunk storage.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "storage.h"
+#include "asyncio.h"
+#include "compress.h"
+#include "residency.h"
+
+#define PATH_SIZE 256
+
+/*
+ * An entry of the open hunk file cache.
+ */
+typedef struct HunkFileTag
+{
+    int h[3]; // hunk coordinates
+    int fd; // -1 if the file is known not to exist
+    int users; // requests in flight on @fd
+    int used; // entry holds a hunk
+} HunkFile;
+
+typedef struct LoadTag
+{
+    Chunk* chunk;
+    HunkFile* hunk;
+    LoadCallback done;
+    unsigned char slot[SLOT_SIZE];
+} Load;
+
+/*
+ * A write in flight. Loads of the same chunk are served from it, so they
+ * never see the data the write is replacing. There is at most one per
+ * chunk: saving a chunk that is still being written puts the new slot in
+ * @next_slot, which is written once the first write is done, so writes of
+ * a slot always land in the order they were made.
+ */
+typedef struct SaveTag
+{
+    int c[3]; // chunk coordinates
+    HunkFile* hunk;
+    long offset;
+    unsigned char slot[SLOT_SIZE]; // being written
+    unsigned char next_slot[SLOT_SIZE];
+    int again; // @next_slot holds a newer slot to write after @slot
+    struct SaveTag* next;
+} Save;
+
+static char world_dir[PATH_SIZE];
+static HunkFile hunks[MAX_OPEN_HUNKS];
+static int next_victim = 0;
+static Save* saves = NULL;
+
+/*
+ * Find or open the file of a hunk. Returns NULL if the file does not
+ * exist and @create is 0, or if it can't be opened.
+ */
+static HunkFile* open_hunk(int hx, int hy, int hz, int create)
+{
+    char path[PATH_SIZE];
+    HunkFile* hunk = NULL;
+    int idx;
+    int tries;
+
+    for (idx = 0; idx < MAX_OPEN_HUNKS; idx++)
+    {
+        if (hunks[idx].used && hunks[idx].h[0] == hx &&
+            hunks[idx].h[1] == hy && hunks[idx].h[2] == hz)
+        {
+            hunk = &hunks[idx];
+            break;
+        }
+    }
+
+    if (hunk == NULL)
+    {
+        // evict an idle entry, round robin
+        for (tries = 0; tries < MAX_OPEN_HUNKS; tries++)
+        {
+            idx = next_victim;
+            next_victim = (next_victim + 1) % MAX_OPEN_HUNKS;
+            if (hunks[idx].users == 0)
+            {
+                hunk = &hunks[idx];
+                break;
+            }
+        }
+        if (hunk == NULL)
+        {
+            fprintf(stderr, "Too many hunk files in use.\n");
+            return NULL;
+        }
+        if (hunk->used && hunk->fd >= 0)
+        {
+            close(hunk->fd);
+        }
+        hunk->used = 1;
+        hunk->h[0] = hx;
+        hunk->h[1] = hy;
+        hunk->h[2] = hz;
+        hunk->users = 0;
+        hunk_path(path, PATH_SIZE, world_dir, hx, hy, hz);
+        hunk->fd = open(path, O_RDWR);
+    }
+
+    if (hunk->fd < 0 && create)
+    {
+        hunk_path(path, PATH_SIZE, world_dir, hx, hy, hz);
+        hunk->fd = open(path, O_RDWR | O_CREAT, 0644);
+        if (hunk->fd < 0)
+        {
+            fprintf(stderr, "open %s failed: %d\n", path, errno);
+        }
+    }
+    return (hunk->fd >= 0) ? hunk : NULL;
+}
+
+static HunkFile* open_chunk_hunk(const Chunk* chunk, int create)
+{
+    return open_hunk(hunk_coord(chunk_coord(chunk->a[0])),
+                     hunk_coord(chunk_coord(chunk->a[1])),
+                     hunk_coord(chunk_coord(chunk->a[2])), create);
+}
+
+static long chunk_offset(const Chunk* chunk)
+{
+    return slot_offset(chunk_coord(chunk->a[0]), chunk_coord(chunk->a[1]),
+                       chunk_coord(chunk->a[2]));
+}
+
+static void finish_load(Chunk* chunk, const unsigned char* slot,
+                        LoadCallback done)
+{
+    chunk->io_state = (slot && unpack_slot(slot, chunk)) ? IO_LOADED
+                                                         : IO_ABSENT;
+    __atomic_sub_fetch(&chunk->busy, 1, __ATOMIC_ACQ_REL);
+    if (done)
+    {
+        done(chunk);
+    }
+}
+
+static void load_done(void* arg, long result)
+{
+    Load* load = arg;
+
+    load->hunk->users--;
+    if (result < 0)
+    {
+        fprintf(stderr, "Reading chunk failed: %ld\n", result);
+    }
+    if (result < SLOT_SIZE)
+    {
+        // past the end of the file, the slot was never written
+        memset(load->slot + (result > 0 ? result : 0), 0,
+               SLOT_SIZE - (result > 0 ? result : 0));
+    }
+    finish_load(load->chunk, load->slot, load->done);
+    free(load);
+}
+
+static void save_done(void* arg, long result)
+{
+    Save* save = arg;
+    Save** link;
+
+    if (result != SLOT_SIZE)
+    {
+        fprintf(stderr, "Writing chunk failed: %ld\n", result);
+    }
+    if (save->again)
+    {
+        // the chunk was saved again meanwhile, write the newer slot
+        memcpy(save->slot, save->next_slot, SLOT_SIZE);
+        save->again = 0;
+        async_write(save->hunk->fd, save->slot, SLOT_SIZE, save->offset,
+                    save_done, save);
+        return;
+    }
+    save->hunk->users--;
+    for (link = &saves; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == save)
+        {
+            *link = save->next;
+            break;
+        }
+    }
+    free(save);
+}
+
+int storage_init(const char* dir)
+{
+    int idx;
+
+    snprintf(world_dir, PATH_SIZE, "%s", dir);
+    if (mkdir(world_dir, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "mkdir %s failed: %d\n", world_dir, errno);
+        return -1;
+    }
+    for (idx = 0; idx < MAX_OPEN_HUNKS; idx++)
+    {
+        hunks[idx].used = 0;
+        hunks[idx].fd = -1;
+        hunks[idx].users = 0;
+    }
+    return 0;
+}
+
+const char* storage_dir()
+{
+    return world_dir;
+}
+
+void storage_shutdown()
+{
+    int idx;
+
+    for (idx = 0; idx < MAX_OPEN_HUNKS; idx++)
+    {
+        if (hunks[idx].used && hunks[idx].fd >= 0)
+        {
+            close(hunks[idx].fd);
+        }
+        hunks[idx].used = 0;
+        hunks[idx].fd = -1;
+    }
+}
+
+int hunk_coord(int c)
+{
+    return (c >= 0) ? c / HUNK_SIZE : -((-c + HUNK_SIZE - 1) / HUNK_SIZE);
+}
+
+void hunk_path(char* path, int size, const char* dir, int hx, int hy, int hz)
+{
+    snprintf(path, size, "%s/hunk.%d.%d.%d.dat", dir, hx, hy, hz);
+}
+
+long slot_offset(int cx, int cy, int cz)
+{
+    int x = cx - hunk_coord(cx) * HUNK_SIZE;
+    int y = cy - hunk_coord(cy) * HUNK_SIZE;
+    int z = cz - hunk_coord(cz) * HUNK_SIZE;
+
+    return (long)((x * HUNK_SIZE + y) * HUNK_SIZE + z) * SLOT_SIZE;
+}
+
+void pack_slot(const Chunk* chunk, unsigned char* slot)
+{
+    memset(slot, 0, SLOT_HEADER_SIZE);
+    memcpy(slot, SLOT_MAGIC, 4);
+    if (chunk->ids != NULL)
+    {
+        memcpy(slot + SLOT_HEADER_SIZE, chunk->ids, BLOCKS_PER_CHUNK);
+    }
+    else
+    {
+        rle_decode(chunk->packed, chunk->packed_size,
+                   slot + SLOT_HEADER_SIZE, BLOCKS_PER_CHUNK);
+    }
+}
+
+int unpack_slot(const unsigned char* slot, Chunk* chunk)
+{
+    if (memcmp(slot, SLOT_MAGIC, 4) != 0)
+    {
+        return 0;
+    }
+    chunk_touch(chunk);
+    memcpy(chunk->ids, slot + SLOT_HEADER_SIZE, BLOCKS_PER_CHUNK);
+    return 1;
+}
+
+void storage_load(Chunk* chunk, LoadCallback done)
+{
+    HunkFile* hunk;
+    Load* load;
+    Save* save;
+    int c[3];
+    int i;
+
+    chunk->io_state = IO_READING;
+    __atomic_add_fetch(&chunk->busy, 1, __ATOMIC_ACQ_REL);
+
+    for (i = 0; i < 3; i++)
+    {
+        c[i] = chunk_coord(chunk->a[i]);
+    }
+    for (save = saves; save != NULL; save = save->next)
+    {
+        if (save->c[0] == c[0] && save->c[1] == c[1] && save->c[2] == c[2])
+        {
+            // still being written
+            finish_load(chunk, save->again ? save->next_slot : save->slot,
+                        done);
+            return;
+        }
+    }
+
+    hunk = open_chunk_hunk(chunk, 0);
+    if (hunk == NULL)
+    {
+        finish_load(chunk, NULL, done); // nothing saved in this hunk
+        return;
+    }
+
+    load = malloc(sizeof(Load));
+    load->chunk = chunk;
+    load->hunk = hunk;
+    load->done = done;
+    hunk->users++;
+    async_read(hunk->fd, load->slot, SLOT_SIZE, chunk_offset(chunk),
+               load_done, load);
+}
+
+void storage_save(Chunk* chunk)
+{
+    HunkFile* hunk;
+    Save* save;
+    int c[3];
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        c[i] = chunk_coord(chunk->a[i]);
+    }
+    for (save = saves; save != NULL; save = save->next)
+    {
+        if (save->c[0] == c[0] && save->c[1] == c[1] && save->c[2] == c[2])
+        {
+            // @slot is still being written, queue behind it
+            pack_slot(chunk, save->next_slot);
+            save->again = 1;
+            chunk->modified = 0;
+            return;
+        }
+    }
+
+    hunk = open_chunk_hunk(chunk, 1);
+    if (hunk == NULL)
+    {
+        return;
+    }
+
+    save = malloc(sizeof(Save));
+    memcpy(save->c, c, sizeof(c));
+    save->hunk = hunk;
+    save->offset = chunk_offset(chunk);
+    save->again = 0;
+    pack_slot(chunk, save->slot);
+    save->next = saves;
+    saves = save;
+
+    hunk->users++;
+    async_write(hunk->fd, save->slot, SLOT_SIZE, save->offset,
+                save_done, save);
+    chunk->modified = 0;
+}
+
+void storage_flush(World* world)
+{
+    Chunk* chunk;
+    int idx = 0;
+
+    while ((chunk = world_next(world, &idx)) != NULL)
+    {
+        if (chunk->modified)
+        {
+            storage_save(chunk);
+        }
+    }
+    async_drain();
+}
@@ -0,0 +1,97 @@
+/*
+ * On-disk chunk storage.
+ *
+ * Chunks are saved in hunk files, one per 16x16x16 chunks (HUNK_SIZE), at
+ * WORLD_DIR/hunk.<hx>.<hy>.<hz>.dat. Every chunk of a hunk has a fixed
+ * slot in its file, so reads and writes never have to look anything up:
+ *
+ *   bytes 0-3: SLOT_MAGIC if the slot holds a chunk, zero otherwise
+ *   bytes 4-7: reserved
+ *   bytes 8-:  the chunk's block ids, x-major like Chunk.ids
+ *
+ * Hunk files are sparse, slots of chunks that were never saved take no
+ * space. Only chunks that were edited are saved, everything else can be
+ * generated again.
+ *
+ * All I/O goes through asyncio.h and completes on the main thread.
+ */
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include "chunk.h"
+#include "world.h"
+
+#define WORLD_DIR "world"
+#define SLOT_HEADER_SIZE 8
+#define SLOT_SIZE (SLOT_HEADER_SIZE + BLOCKS_PER_CHUNK)
+#define SLOT_MAGIC "VXC1"
+#define CHUNKS_PER_HUNK (HUNK_SIZE * HUNK_SIZE * HUNK_SIZE)
+#define MAX_OPEN_HUNKS 64
+
+/*
+ * Called on the main thread when a chunk finished loading. The chunk's
+ * io_state is IO_LOADED or IO_ABSENT.
+ */
+typedef void (*LoadCallback)(Chunk* chunk);
+
+/*
+ * Set up storage in directory @dir, creating it if needed. Returns 0 on
+ * success.
+ */
+int storage_init(const char* dir);
+
+/*
+ * Get the directory given to storage_init().
+ */
+const char* storage_dir();
+
+/*
+ * Close all hunk files. Pending I/O must have been drained.
+ */
+void storage_shutdown();
+
+/*
+ * Get the hunk coordinate that chunk coordinate @c falls in.
+ */
+int hunk_coord(int c);
+
+/*
+ * Get the path of a hunk file.
+ */
+void hunk_path(char* path, int size, const char* dir, int hx, int hy, int hz);
+
+/*
+ * Get the offset of a chunk's slot in its hunk file.
+ */
+long slot_offset(int cx, int cy, int cz);
+
+/*
+ * Write a chunk into a slot of SLOT_SIZE bytes. Works on compressed chunks.
+ */
+void pack_slot(const Chunk* chunk, unsigned char* slot);
+
+/*
+ * Read a slot into a chunk's ids. Returns 0 if the slot is empty.
+ */
+int unpack_slot(const unsigned char* slot, Chunk* chunk);
+
+/*
+ * Start reading a chunk from disk. @done (may be NULL) runs once the read
+ * completed. The chunk counts as busy until then.
+ */
+void storage_load(Chunk* chunk, LoadCallback done);
+
+/*
+ * Start writing a chunk to disk. The chunk's data is copied, so the chunk
+ * may be freed right away. Saving a chunk whose last save is still being
+ * written waits for that write, so the newest save always lands last.
+ */
+void storage_save(Chunk* chunk);
+
+/*
+ * Save every modified chunk of @world and wait for all I/O to finish.
+ */
+void storage_flush(World* world);
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * Implementation of terrain generation.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "terrain.h"
+#include "noise.h"
+#include "world.h"
+
+static int pick_biome(float temperature, float humidity)
+{
+    if (temperature < -0.3f)
+    {
+        return BIOME_MOUNTAINS;
+    }
+    if (temperature > 0.3f && humidity < 0.0f)
+    {
+        return BIOME_DESERT;
+    }
+    return (temperature < 0.0f) ? BIOME_HILLS : BIOME_PLAINS;
+}
+
+void terrain_fill_column(Column* column)
+{
+    float wx;
+    float wz;
+    float cold;
+    float amplitude;
+    int x;
+    int z;
+    int height;
+
+    column->min_height = 0x7fff;
+    column->max_height = -0x7fff;
+    for (x = 0; x < CHUNK_SIZE; x++)
+    {
+        for (z = 0; z < CHUNK_SIZE; z++)
+        {
+            wx = (float)(column->c[0] * CHUNK_SIZE + x);
+            wz = (float)(column->c[1] * CHUNK_SIZE + z);
+            column->temperature[x][z] =
+                fbm2(wx * CLIMATE_SCALE, wz * CLIMATE_SCALE, 2,
+                     TERRAIN_SEED + 100);
+            column->humidity[x][z] =
+                fbm2(wx * CLIMATE_SCALE, wz * CLIMATE_SCALE, 2,
+                     TERRAIN_SEED + 200);
+            column->biome[x][z] = (unsigned char)pick_biome(
+                column->temperature[x][z], column->humidity[x][z]);
+
+            // the colder, the rougher; no seams at biome borders
+            cold = (1.0f - column->temperature[x][z]) * 0.5f;
+            amplitude = TERRAIN_MIN_AMPLITUDE +
+                        cold * (TERRAIN_MAX_AMPLITUDE - TERRAIN_MIN_AMPLITUDE);
+            height = TERRAIN_BASE + (int)floorf(amplitude *
+                fbm2(wx * TERRAIN_SCALE, wz * TERRAIN_SCALE, TERRAIN_OCTAVES,
+                     TERRAIN_SEED));
+
+            column->height[x][z] = (short)height;
+            if (height < column->min_height)
+            {
+                column->min_height = height;
+            }
+            if (height > column->max_height)
+            {
+                column->max_height = height;
+            }
+        }
+    }
+}
+
+void generate_terrain(Chunk* chunk)
+{
+    Column* column;
+    int x;
+    int z;
+    int top;
+
+    if (chunk->column == NULL)
+    {
+        chunk->column = column_acquire(chunk_coord(chunk->a[0]),
+                                       chunk_coord(chunk->a[2]),
+                                       terrain_fill_column);
+    }
+    column = chunk->column;
+
+    // block dy of this chunk is at y = a[1] + dy
+    if (chunk->a[1] > column->max_height)
+    {
+        return; // all air
+    }
+    if (chunk->a[1] + CHUNK_SIZE - 1 <= column->min_height)
+    {
+        memset(chunk->ids, BLOCK_DIRT, BLOCKS_PER_CHUNK);
+        return;
+    }
+
+    for (x = 0; x < CHUNK_SIZE; x++)
+    {
+        for (z = 0; z < CHUNK_SIZE; z++)
+        {
+            top = column->height[x][z] - chunk->a[1];
+            if (top >= CHUNK_SIZE)
+            {
+                top = CHUNK_SIZE - 1;
+            }
+            for (; top >= 0; top--)
+            {
+                (chunk->ids)[x][top][z] = BLOCK_DIRT;
+            }
+        }
+    }
+}
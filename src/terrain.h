@@ -0,0 +1,41 @@
+/*
+ * Terrain generation: rolling dirt terrain whose roughness follows the
+ * climate.
+ *
+ * The 2D fields (height, climate, biome) of a chunk's footprint come from
+ * the column cache (see column.h), so they are computed once per column
+ * and not once per chunk.
+ */
+
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include "chunk.h"
+#include "column.h"
+
+#define TERRAIN_SEED 1234u
+#define TERRAIN_BASE 0 // height of flat ground
+#define TERRAIN_MIN_AMPLITUDE 3.0f // height variation of warm terrain
+#define TERRAIN_MAX_AMPLITUDE 24.0f // height variation of cold terrain
+#define TERRAIN_SCALE (1.0f / 64.0f) // frequency of height noise
+#define CLIMATE_SCALE (1.0f / 512.0f) // frequency of climate noise
+#define TERRAIN_OCTAVES 4
+
+// biomes
+#define BIOME_PLAINS 0
+#define BIOME_DESERT 1 // warm and dry
+#define BIOME_HILLS 2
+#define BIOME_MOUNTAINS 3 // cold
+
+/*
+ * Compute the fields of a column. A ColumnFill, see column.h.
+ */
+void terrain_fill_column(Column* column);
+
+/*
+ * Generate the blocks of a chunk from its column. A StageFunc, see
+ * pipeline.h; runs on a worker thread.
+ */
+void generate_terrain(Chunk* chunk);
+
+#endif
@@ -0,0 +1,194 @@
+/*
+ * Implementation of the world's chunk table.
+ */
+
+#include <stdlib.h>
+
+#include "world.h"
+
+#define MIN_SLOTS 256
+
+static unsigned int hash(int cx, int cy, int cz)
+{
+    return ((unsigned int)cx * 73856093u) ^
+           ((unsigned int)cy * 19349663u) ^
+           ((unsigned int)cz * 83492791u);
+}
+
+static unsigned int chunk_hash(const Chunk* chunk)
+{
+    return hash(chunk_coord(chunk->a[0]),
+                chunk_coord(chunk->a[1]),
+                chunk_coord(chunk->a[2]));
+}
+
+static int matches(const Chunk* chunk, int cx, int cy, int cz)
+{
+    return chunk->a[0] == cx * CHUNK_SIZE &&
+           chunk->a[1] == cy * CHUNK_SIZE &&
+           chunk->a[2] == cz * CHUNK_SIZE;
+}
+
+static void insert(World* world, Chunk* chunk)
+{
+    unsigned int mask = world->capacity - 1;
+    unsigned int idx = chunk_hash(chunk) & mask;
+
+    while (world->slots[idx] != NULL)
+    {
+        idx = (idx + 1) & mask;
+    }
+    world->slots[idx] = chunk;
+    world->count++;
+}
+
+static void grow(World* world)
+{
+    Chunk** old_slots = world->slots;
+    int old_capacity = world->capacity;
+    int idx;
+
+    world->capacity *= 2;
+    world->slots = calloc(world->capacity, sizeof(Chunk*));
+    world->count = 0;
+    for (idx = 0; idx < old_capacity; idx++)
+    {
+        if (old_slots[idx] != NULL)
+        {
+            insert(world, old_slots[idx]);
+        }
+    }
+    free(old_slots);
+}
+
+World* construct_world()
+{
+    World* new_world;
+
+    new_world = malloc(sizeof(World));
+    new_world->capacity = MIN_SLOTS;
+    new_world->slots = calloc(new_world->capacity, sizeof(Chunk*));
+    new_world->count = 0;
+
+    return new_world;
+}
+
+Chunk* world_get(const World* world, int cx, int cy, int cz)
+{
+    unsigned int mask = world->capacity - 1;
+    unsigned int idx = hash(cx, cy, cz) & mask;
+
+    while (world->slots[idx] != NULL)
+    {
+        if (matches(world->slots[idx], cx, cy, cz))
+        {
+            return world->slots[idx];
+        }
+        idx = (idx + 1) & mask;
+    }
+    return NULL;
+}
+
+Chunk* world_add(World* world, int cx, int cy, int cz)
+{
+    Chunk* chunk = world_get(world, cx, cy, cz);
+
+    if (chunk)
+    {
+        return chunk;
+    }
+    if (2 * (world->count + 1) > world->capacity)
+    {
+        grow(world); // keep load factor under 1/2
+    }
+    chunk = construct_chunk(cx * CHUNK_SIZE, cy * CHUNK_SIZE, cz * CHUNK_SIZE);
+    insert(world, chunk);
+    return chunk;
+}
+
+void world_remove(World* world, Chunk* chunk)
+{
+    unsigned int mask = world->capacity - 1;
+    unsigned int idx = chunk_hash(chunk) & mask;
+    unsigned int next;
+    unsigned int home;
+
+    while (world->slots[idx] != chunk)
+    {
+        if (world->slots[idx] == NULL)
+        {
+            return; // not in this world
+        }
+        idx = (idx + 1) & mask;
+    }
+
+    // backward-shift deletion: pull later members of the cluster into the
+    // hole if their home slot allows it
+    world->slots[idx] = NULL;
+    world->count--;
+    next = (idx + 1) & mask;
+    while (world->slots[next] != NULL)
+    {
+        home = chunk_hash(world->slots[next]) & mask;
+        if (((next - home) & mask) >= ((next - idx) & mask))
+        {
+            world->slots[idx] = world->slots[next];
+            world->slots[next] = NULL;
+            idx = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+Chunk* world_next(const World* world, int* idx)
+{
+    while (*idx < world->capacity)
+    {
+        if (world->slots[(*idx)++] != NULL)
+        {
+            return world->slots[*idx - 1];
+        }
+    }
+    return NULL;
+}
+
+int world_chunk_hidden(const World* world, const Chunk* chunk)
+{
+    const Chunk* neighbour;
+    int dir;
+
+    if (!__atomic_load_n(&chunk->solid_ready, __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+    if (chunk->flags & CHUNK_ALL_AIR)
+    {
+        return 1;
+    }
+    if (!(chunk->flags & CHUNK_ALL_SOLID))
+    {
+        return 0;
+    }
+
+    for (dir = 0; dir < DIR_COUNT; dir++)
+    {
+        neighbour = world_get(world,
+                              chunk_coord(chunk->a[0]) + DIR_OFFSETS[dir][0],
+                              chunk_coord(chunk->a[1]) + DIR_OFFSETS[dir][1],
+                              chunk_coord(chunk->a[2]) + DIR_OFFSETS[dir][2]);
+        // DIR_* come in opposite pairs, dir ^ 1 faces back at this chunk
+        if (neighbour == NULL ||
+            !__atomic_load_n(&neighbour->solid_ready, __ATOMIC_ACQUIRE) ||
+            !chunk_plane_solid(neighbour, dir ^ 1))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int chunk_coord(int x)
+{
+    // floor division, so -1 is in chunk -1 and not chunk 0
+    return (x >= 0) ? x / CHUNK_SIZE : -((-x + CHUNK_SIZE - 1) / CHUNK_SIZE);
+}
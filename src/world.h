@@ -0,0 +1,62 @@
+/*
+ * The world: every loaded chunk, found by its chunk coordinates.
+ *
+ * Chunk (cx, cy, cz) has its top-northeast corner at
+ * (cx * CHUNK_SIZE, cy * CHUNK_SIZE, cz * CHUNK_SIZE).
+ *
+ * The chunk table is only touched from the main thread. Jobs get handed
+ * the chunks they work on and never look chunks up themselves.
+ */
+
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "chunk.h"
+
+typedef struct WorldTag
+{
+    Chunk** slots; // open addressing, NULL if empty
+    int capacity; // always a power of two
+    int count;
+} World;
+
+/*
+ * Construct an empty world.
+ */
+World* construct_world();
+
+/*
+ * Get the chunk at chunk coordinates @cx, @cy, @cz, NULL if not loaded.
+ */
+Chunk* world_get(const World* world, int cx, int cy, int cz);
+
+/*
+ * Get the chunk at chunk coordinates @cx, @cy, @cz, constructing an empty
+ * chunk if it is not loaded yet.
+ */
+Chunk* world_add(World* world, int cx, int cy, int cz);
+
+/*
+ * Take a chunk out of the world. Does not free the chunk.
+ */
+void world_remove(World* world, Chunk* chunk);
+
+/*
+ * Iterate over the chunks of a world. Start with @idx at 0, returns NULL
+ * when done. The world must not change during iteration.
+ */
+Chunk* world_next(const World* world, int* idx);
+
+/*
+ * Check if a chunk has nothing to draw: it is all air, or all solid and
+ * walled in by solid neighbours. Chunks still being generated are not
+ * hidden.
+ */
+int world_chunk_hidden(const World* world, const Chunk* chunk);
+
+/*
+ * Get the chunk coordinate that block coordinate @x falls in.
+ */
+int chunk_coord(int x);
+
+#endif